@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Linux userspace port. The SPI interface given to the library is a nrf24l01_linux_spi and the
+// ports of the pins are nrf24l01_linux_gpio lines (the pin numbers are not used). CSN is driven
+// by the spidev driver itself, so the library is given a NULL CSN port. This lets it batch a
+// whole queue of commands into a single SPI_IOC_MESSAGE.
+
+/**
+ * Maximum number of segments transferred with a single SPI_IOC_MESSAGE.
+ */
+#define NRF24L01_LINUX_MAX_SEGMENTS 32
+
+/**
+ * A spidev device node, ex. /dev/spidev0.0.
+ */
+typedef struct {
+    int fd;
+    uint32_t speed_hz;
+} nrf24l01_linux_spi;
+
+/**
+ * A single line requested from a GPIO character device, ex. /dev/gpiochip0.
+ */
+typedef struct {
+    int fd;
+} nrf24l01_linux_gpio;
+
+/**
+ * Opens a spidev device node in SPI mode 0.
+ * @param self The nrf24l01_linux_spi struct to initialize.
+ * @param path The path of the device node. Ex. "/dev/spidev0.0".
+ * @param speed_hz The SPI clock frequency (Hz).
+ * @return Whether the device node could be opened and configured.
+ */
+bool nrf24l01_linux_spi_open(nrf24l01_linux_spi *self, const char *path, uint32_t speed_hz);
+
+/**
+ * Connects MOSI to MISO inside the SPI controller (SPI_LOOP), so that every byte received is the
+ * byte transmitted. Not supported by all controllers. Used by the self-test.
+ * @param self The nrf24l01_linux_spi struct to act upon.
+ * @param enabled Whether to enable or disable the loopback.
+ * @return Whether the controller accepted the mode.
+ */
+bool nrf24l01_linux_spi_set_loopback(nrf24l01_linux_spi *self, bool enabled);
+
+/**
+ * Closes a spidev device node.
+ * @param self The nrf24l01_linux_spi struct to act upon.
+ */
+void nrf24l01_linux_spi_close(nrf24l01_linux_spi *self);
+
+/**
+ * Requests a GPIO line as an output, ex. for CE.
+ * @param self The nrf24l01_linux_gpio struct to initialize.
+ * @param chip_path The path of the GPIO character device. Ex. "/dev/gpiochip0".
+ * @param offset The offset of the line in the chip.
+ * @param value The initial value of the line (0 or 1).
+ * @return Whether the line could be requested.
+ */
+bool nrf24l01_linux_gpio_open_output(nrf24l01_linux_gpio *self, const char *chip_path, uint32_t offset, bool value);
+
+/**
+ * Requests a GPIO line as an input with edge detection, for the IRQ pin. Waiting on the line
+ * sleeps in the kernel until an edge is reported.
+ * @param self The nrf24l01_linux_gpio struct to initialize.
+ * @param chip_path The path of the GPIO character device. Ex. "/dev/gpiochip0".
+ * @param offset The offset of the line in the chip.
+ * @return Whether the line could be requested.
+ */
+bool nrf24l01_linux_gpio_open_irq(nrf24l01_linux_gpio *self, const char *chip_path, uint32_t offset);
+
+/**
+ * Releases a GPIO line.
+ * @param self The nrf24l01_linux_gpio struct to act upon.
+ */
+void nrf24l01_linux_gpio_close(nrf24l01_linux_gpio *self);
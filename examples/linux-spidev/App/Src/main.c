@@ -0,0 +1,217 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nrf24l01.h"
+#include "nrf24l01_linux.h"
+#include "spi_interface.h"
+#include "spi_stats.h"
+
+#define SPI_SPEED_HZ 8000000
+
+#define PACKET_COUNT 128
+
+static int run(nrf24l01 *device, bool transmit) {
+    nrf24l01_power_up(device);
+
+    nrf24l01_set_channel(device, 32);
+
+    nrf24l01_set_data_rate(device, DATA_RATE_HIGH);
+
+    nrf24l01_set_power_level(device, POWER_LEVEL_LOW);
+
+    uint8_t buffers[PACKET_COUNT][32];
+    uint8_t *packets[PACKET_COUNT];
+    uint8_t payload_lengths[PACKET_COUNT];
+    for (int i = 0; i < PACKET_COUNT; i++) {
+        memset(buffers[i], i, 32);
+        packets[i] = buffers[i];
+        payload_lengths[i] = 32;
+    }
+
+    uint32_t start = nrf24l01_hal_get_us_ticks();
+    if (transmit) {
+        nrf24l01_set_pipe0_write(device, 0x15);
+        nrf24l01_send_packets(device, packets, PACKET_COUNT, payload_lengths, true);
+        printf("Sent %d packets in %lu us\n", PACKET_COUNT, (unsigned long) nrf24l01_hal_elapsed_us(start));
+    } else {
+        nrf24l01_set_pipe_read(device, 1, 0x15);
+        int count = nrf24l01_receive_packets_us(device, packets, PACKET_COUNT, 1000);
+        printf("Received %d packets in %lu us\n", count, (unsigned long) nrf24l01_hal_elapsed_us(start));
+    }
+
+    spi_stats_dump();
+    return 0;
+}
+
+// More commands than fit in a single SPI_IOC_MESSAGE batch of the library
+#define SELFTEST_COMMANDS 20
+
+// Checks the batching of the port without a device. With the SPI controller in loopback, the
+// STATUS byte read by each command is its own command byte, and a segment reads what it sends.
+static bool selftest_spi(nrf24l01_linux_spi *spi) {
+    if (!nrf24l01_linux_spi_set_loopback(spi, true)) {
+        printf("SPI loopback is not supported by the controller\n");
+        return false;
+    }
+
+    bool passed = true;
+
+    // A queue through the library, which CSN-frames each command within a few messages
+    spi_interface interface;
+    spi_interface_init(&interface, spi, NULL, 0, NULL, 0);
+    uint8_t data[SELFTEST_COMMANDS];
+    spi_interface_command commands[SELFTEST_COMMANDS];
+    spi_interface_queue queue;
+    spi_interface_queue_init(&queue, commands, SELFTEST_COMMANDS);
+    for (int i = 0; i < SELFTEST_COMMANDS; i++) {
+        data[i] = (uint8_t) (0xA0 + i);
+        spi_interface_queue_add(&queue, (uint8_t) (0x20 + i), &data[i], 1, NULL, 0);
+    }
+    spi_interface_run_queue(&interface, &queue);
+    for (int i = 0; i < SELFTEST_COMMANDS; i++) {
+        if (commands[i].status != commands[i].command) {
+            printf("Command %d: read %02X instead of %02X\n", i, commands[i].status, commands[i].command);
+            passed = false;
+        }
+    }
+
+    // Full-duplex segments handed to the port directly, split into frames
+    uint8_t tx_data[3][4] = { { 1, 2, 3, 4 }, { 5, 6, 7, 8 }, { 9, 10, 11, 12 } };
+    uint8_t rx_data[3][4] = { 0 };
+    nrf24l01_hal_spi_segment segments[3] = {
+        { tx_data[0], rx_data[0], 4, false },
+        { tx_data[1], rx_data[1], 4, true },
+        { tx_data[2], rx_data[2], 4, true },
+    };
+    if (nrf24l01_hal_spi_transfer(spi, segments, 3, UINT32_MAX) != 0 || memcmp(tx_data, rx_data, sizeof(tx_data)) != 0) {
+        printf("Segments were not transferred back to back\n");
+        passed = false;
+    }
+
+    nrf24l01_linux_spi_set_loopback(spi, false);
+    printf("SPI: %s\n", passed ? "passed" : "failed");
+    return passed;
+}
+
+typedef struct {
+    nrf24l01_linux_gpio *line;
+    uint32_t delay_us;
+} selftest_lower;
+
+static void *selftest_lower_line(void *context) {
+    selftest_lower *lower = context;
+    nrf24l01_hal_sleep_us(lower->delay_us);
+    nrf24l01_hal_write_pin(lower->line, 0, 0);
+    return NULL;
+}
+
+// Checks waiting on the IRQ pin, with an output line wired to the IRQ line standing in for the
+// device
+static bool selftest_wait_pin(const char *chip_path, uint32_t output_offset, uint32_t irq_offset) {
+    nrf24l01_linux_gpio output, irq;
+    if (!nrf24l01_linux_gpio_open_output(&output, chip_path, output_offset, 1)) {
+        perror(chip_path);
+        return false;
+    }
+    if (!nrf24l01_linux_gpio_open_irq(&irq, chip_path, irq_offset)) {
+        perror(chip_path);
+        nrf24l01_linux_gpio_close(&output);
+        return false;
+    }
+
+    bool passed = true;
+
+    // The line stays high, so the wait must time out
+    uint32_t start = nrf24l01_hal_get_us_ticks();
+    if (nrf24l01_hal_wait_pin(&irq, 0, 0, 10000) || nrf24l01_hal_elapsed_us(start) < 10000) {
+        printf("Waiting on a high line didn't time out\n");
+        passed = false;
+    }
+
+    // The line is lowered by another thread while waiting, which must wake the wait up
+    selftest_lower lower = { &output, 10000 };
+    pthread_t thread;
+    pthread_create(&thread, NULL, selftest_lower_line, &lower);
+    start = nrf24l01_hal_get_us_ticks();
+    if (!nrf24l01_hal_wait_pin(&irq, 0, 0, 1000000)) {
+        printf("The falling edge was missed\n");
+        passed = false;
+    } else {
+        printf("Woke up %lu us after the wait started\n", (unsigned long) nrf24l01_hal_elapsed_us(start));
+    }
+    pthread_join(thread, NULL);
+
+    nrf24l01_linux_gpio_close(&irq);
+    nrf24l01_linux_gpio_close(&output);
+    printf("IRQ pin: %s\n", passed ? "passed" : "failed");
+    return passed;
+}
+
+static int selftest(int argc, char **argv) {
+    nrf24l01_linux_spi spi;
+    if (!nrf24l01_linux_spi_open(&spi, argv[2], SPI_SPEED_HZ)) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    bool passed = selftest_spi(&spi);
+    nrf24l01_linux_spi_close(&spi);
+
+    if (argc > 5) {
+        passed &= selftest_wait_pin(argv[3], strtoul(argv[4], NULL, 0), strtoul(argv[5], NULL, 0));
+    }
+    return passed ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2 && strcmp(argv[1], "selftest") == 0) {
+        return selftest(argc, argv);
+    }
+
+    if (argc < 5 || (strcmp(argv[1], "tx") != 0 && strcmp(argv[1], "rx") != 0)) {
+        printf("Usage: %s tx|rx SPIDEV GPIOCHIP CE_LINE [IRQ_LINE]\n", argv[0]);
+        printf("       %s selftest SPIDEV [GPIOCHIP OUTPUT_LINE IRQ_LINE]\n", argv[0]);
+        printf("Ex. %s rx /dev/spidev0.0 /dev/gpiochip0 25 24\n", argv[0]);
+        return 1;
+    }
+
+    nrf24l01_linux_spi spi;
+    if (!nrf24l01_linux_spi_open(&spi, argv[2], SPI_SPEED_HZ)) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    nrf24l01_linux_gpio ce;
+    if (!nrf24l01_linux_gpio_open_output(&ce, argv[3], strtoul(argv[4], NULL, 0), 0)) {
+        perror(argv[3]);
+        return 1;
+    }
+
+    // CSN is driven by spidev
+    nrf24l01 device;
+    uint8_t address_prefix[4] = {0xB3, 0xB4, 0xB5, 0xB6};
+    if (!nrf24l01_init(&device, address_prefix, &spi, NULL, 0, &ce, 0)) {
+        printf("Could not initialize device\n");
+        return 1;
+    }
+
+    nrf24l01_linux_gpio irq;
+    if (argc > 5) {
+        if (!nrf24l01_linux_gpio_open_irq(&irq, argv[3], strtoul(argv[5], NULL, 0))) {
+            perror(argv[3]);
+            return 1;
+        }
+        nrf24l01_set_irq_pin(&device, &irq, 0);
+    }
+
+    int result = run(&device, strcmp(argv[1], "tx") == 0);
+
+    if (argc > 5) {
+        nrf24l01_linux_gpio_close(&irq);
+    }
+    nrf24l01_linux_gpio_close(&ce);
+    nrf24l01_linux_spi_close(&spi);
+    return result;
+}
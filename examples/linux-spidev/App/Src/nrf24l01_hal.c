@@ -0,0 +1,231 @@
+#include "nrf24l01_hal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#include "nrf24l01_linux.h"
+
+bool nrf24l01_linux_spi_open(nrf24l01_linux_spi *self, const char *path, uint32_t speed_hz) {
+    self->fd = open(path, O_RDWR | O_CLOEXEC);
+    if (self->fd < 0) {
+        return false;
+    }
+    self->speed_hz = speed_hz;
+
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    if (ioctl(self->fd, SPI_IOC_WR_MODE, &mode) < 0 || ioctl(self->fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+        ioctl(self->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) < 0) {
+        nrf24l01_linux_spi_close(self);
+        return false;
+    }
+    return true;
+}
+
+bool nrf24l01_linux_spi_set_loopback(nrf24l01_linux_spi *self, bool enabled) {
+    uint8_t mode = enabled ? SPI_MODE_0 | SPI_LOOP : SPI_MODE_0;
+    return ioctl(self->fd, SPI_IOC_WR_MODE, &mode) >= 0;
+}
+
+void nrf24l01_linux_spi_close(nrf24l01_linux_spi *self) {
+    close(self->fd);
+    self->fd = -1;
+}
+
+static bool nrf24l01_linux_gpio_request(
+        nrf24l01_linux_gpio *self, const char *chip_path, uint32_t offset, uint64_t flags, bool value) {
+    int chip = open(chip_path, O_RDWR | O_CLOEXEC);
+    if (chip < 0) {
+        return false;
+    }
+
+    struct gpio_v2_line_request request;
+    memset(&request, 0, sizeof(request));
+    request.offsets[0] = offset;
+    request.num_lines = 1;
+    strncpy(request.consumer, "nrf24l01", sizeof(request.consumer) - 1);
+    request.config.flags = flags;
+    if (flags & GPIO_V2_LINE_FLAG_OUTPUT) {
+        request.config.num_attrs = 1;
+        request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+        request.config.attrs[0].attr.values = value;
+        request.config.attrs[0].mask = 1;
+    }
+
+    // The line stays requested through its own file descriptor
+    int result = ioctl(chip, GPIO_V2_GET_LINE_IOCTL, &request);
+    close(chip);
+    if (result < 0) {
+        return false;
+    }
+
+    self->fd = request.fd;
+    return true;
+}
+
+bool nrf24l01_linux_gpio_open_output(nrf24l01_linux_gpio *self, const char *chip_path, uint32_t offset, bool value) {
+    return nrf24l01_linux_gpio_request(self, chip_path, offset, GPIO_V2_LINE_FLAG_OUTPUT, value);
+}
+
+bool nrf24l01_linux_gpio_open_irq(nrf24l01_linux_gpio *self, const char *chip_path, uint32_t offset) {
+    uint64_t flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_FALLING | GPIO_V2_LINE_FLAG_EDGE_RISING;
+    return nrf24l01_linux_gpio_request(self, chip_path, offset, flags, 0);
+}
+
+void nrf24l01_linux_gpio_close(nrf24l01_linux_gpio *self) {
+    close(self->fd);
+    self->fd = -1;
+}
+
+void nrf24l01_hal_write_pin(void *port, uint16_t pin, bool value) {
+    (void) pin;
+
+    // A NULL CSN port leaves CSN to the spidev driver
+    if (port == NULL) {
+        return;
+    }
+
+    nrf24l01_linux_gpio *gpio = port;
+    struct gpio_v2_line_values values = { value, 1 };
+    ioctl(gpio->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+}
+
+bool nrf24l01_hal_wait_pin(void *port, uint16_t pin, bool value, uint32_t timeout_us) {
+    (void) pin;
+
+    nrf24l01_linux_gpio *gpio = port;
+    uint32_t start = nrf24l01_hal_get_us_ticks();
+    while (true) {
+        struct gpio_v2_line_values values = { 0, 1 };
+        if (ioctl(gpio->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+            return false;
+        }
+        if ((values.bits & 1) == value) {
+            return true;
+        }
+
+        // Sleep until the next edge. An edge that happened since the value was read is already
+        // queued, so it can't be missed.
+        struct timespec remaining;
+        struct timespec *timeout = NULL;
+        if (timeout_us != UINT32_MAX) {
+            uint32_t elapsed = nrf24l01_hal_elapsed_us(start);
+            if (elapsed >= timeout_us) {
+                return false;
+            }
+            remaining.tv_sec = (timeout_us - elapsed) / 1000000;
+            remaining.tv_nsec = (long) ((timeout_us - elapsed) % 1000000) * 1000;
+            timeout = &remaining;
+        }
+
+        struct pollfd poll_fd = { gpio->fd, POLLIN, 0 };
+        int result = ppoll(&poll_fd, 1, timeout, NULL);
+        if (result < 0 && errno != EINTR) {
+            return false;
+        }
+        if (result > 0) {
+            struct gpio_v2_line_event event;
+            if (read(gpio->fd, &event, sizeof(event)) < 0) {
+                return false;
+            }
+        }
+        nrf24l01_hal_idle();
+    }
+}
+
+uint8_t nrf24l01_hal_spi_transfer(
+        void *spi, const nrf24l01_hal_spi_segment *segments, uint32_t count, uint32_t timeout) {
+    // The driver applies its own timeout
+    (void) timeout;
+
+    nrf24l01_linux_spi *device = spi;
+    if (count == 0 || count > NRF24L01_LINUX_MAX_SEGMENTS) {
+        return 1;
+    }
+
+    // All the segments go out in a single message. CSN is raised between the frames with
+    // cs_change, which at the last transfer would instead keep it low after the message.
+    struct spi_ioc_transfer transfers[NRF24L01_LINUX_MAX_SEGMENTS];
+    memset(transfers, 0, count * sizeof(struct spi_ioc_transfer));
+    for (uint32_t i = 0; i < count; i++) {
+        transfers[i].tx_buf = (uintptr_t) segments[i].tx_data;
+        transfers[i].rx_buf = (uintptr_t) segments[i].rx_data;
+        transfers[i].len = segments[i].size;
+        transfers[i].speed_hz = device->speed_hz;
+        transfers[i].bits_per_word = 8;
+        transfers[i].cs_change = segments[i].frame_end && i < count - 1;
+    }
+
+    return ioctl(device->fd, SPI_IOC_MESSAGE(count), transfers) < 0 ? 1 : 0;
+}
+
+bool nrf24l01_hal_spi_transfer_async(void *spi, const nrf24l01_hal_spi_segment *segment, void *context) {
+    // spidev has no asynchronous interface
+    (void) spi;
+    (void) segment;
+    (void) context;
+    return false;
+}
+
+void nrf24l01_hal_spi_configure(void *spi, uint32_t settings) {
+    // The settings of a device on a shared bus are its clock frequency (Hz)
+    nrf24l01_linux_spi *device = spi;
+    device->speed_hz = settings;
+}
+
+bool nrf24l01_hal_spi_set_clock_step(void *spi, uint32_t step, uint32_t *frequency, uint32_t *settings) {
+    static const uint32_t frequencies[] = { 500000, 1000000, 2000000, 4000000, 8000000, 10000000 };
+    if (step >= sizeof(frequencies) / sizeof(frequencies[0])) {
+        return false;
+    }
+
+    nrf24l01_linux_spi *device = spi;
+    device->speed_hz = frequencies[step];
+    *frequency = frequencies[step];
+    *settings = frequencies[step];
+    return true;
+}
+
+// There are no interrupts in userspace, but several threads may use a shared bus
+static pthread_mutex_t critical_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+uint32_t nrf24l01_hal_enter_critical() {
+    pthread_mutex_lock(&critical_mutex);
+    return 0;
+}
+
+void nrf24l01_hal_exit_critical(uint32_t state) {
+    (void) state;
+    pthread_mutex_unlock(&critical_mutex);
+}
+
+void nrf24l01_hal_sleep_us(uint32_t us) {
+    nrf24l01_hal_idle();
+
+    struct timespec remaining = { us / 1000000, (long) (us % 1000000) * 1000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, 0, &remaining, &remaining) == EINTR) {
+    }
+}
+
+uint32_t nrf24l01_hal_get_us_ticks() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) ((uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+#ifdef NRF24L01_INSTRUMENTATION
+uint32_t nrf24l01_hal_get_cycles() {
+    // Nanoseconds stand in for cycles
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t) ((uint64_t) now.tv_sec * 1000000000 + now.tv_nsec);
+}
+#endif
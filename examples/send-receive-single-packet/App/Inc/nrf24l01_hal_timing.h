@@ -0,0 +1,121 @@
+#pragma once
+
+// Timing and critical sections of the STM32F1 ports, shared by the HAL based port
+// (nrf24l01_hal.c) and the register-level port (nrf24l01_hal_port.h), which differ in their GPIO
+// and SPI functions only.
+
+#include "nrf24l01_hal.h"
+
+#include "stm32f1xx_hal.h"
+
+NRF24L01_HAL_FUNCTION uint32_t nrf24l01_hal_enter_critical() {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+NRF24L01_HAL_FUNCTION void nrf24l01_hal_exit_critical(uint32_t state) {
+    __set_PRIMASK(state);
+}
+
+// TIM2 counts microseconds and its compare channel 1 wakes the core up from WFE. Its NVIC line
+// stays disabled: with SEVONPEND, the interrupt becoming pending is enough to wake the core up,
+// so no handler is ever run (TIM2_IRQHandler is not defined).
+// TIM3 counts the overflows of TIM2 (clocked by its update event through ITR1), so together they
+// form the 32-bit microsecond clock, without relying on interrupts to extend it.
+#define SLEEP_TIMER TIM2
+#define SLEEP_TIMER_IRQ TIM2_IRQn
+#define SLEEP_TIMER_HIGH TIM3
+#define SLEEP_TIMER_MAX_CHUNK 0x8000
+
+static inline void sleep_timer_init() {
+    if (SLEEP_TIMER->CR1 & TIM_CR1_CEN) {
+        return;
+    }
+
+    // The timers on APB1 run at twice PCLK1 when APB1 is divided
+    __HAL_RCC_TIM2_CLK_ENABLE();
+    __HAL_RCC_TIM3_CLK_ENABLE();
+    uint32_t clock = HAL_RCC_GetPCLK1Freq();
+    if ((RCC->CFGR & RCC_CFGR_PPRE1) != RCC_CFGR_PPRE1_DIV1) {
+        clock *= 2;
+    }
+
+    SLEEP_TIMER->PSC = clock / 1000000 - 1;
+    SLEEP_TIMER->ARR = 0xFFFF;
+    SLEEP_TIMER->EGR = TIM_EGR_UG;
+    SLEEP_TIMER->SR = 0;
+    SLEEP_TIMER->DIER = TIM_DIER_CC1IE;
+
+    // External clock mode 1 on ITR1 (TIM2), once the forced update above is out of the way
+    SLEEP_TIMER_HIGH->PSC = 0;
+    SLEEP_TIMER_HIGH->ARR = 0xFFFF;
+    SLEEP_TIMER_HIGH->EGR = TIM_EGR_UG;
+    SLEEP_TIMER_HIGH->CNT = 0;
+    SLEEP_TIMER_HIGH->SMCR = TIM_SMCR_TS_0 | TIM_SMCR_SMS;
+    SLEEP_TIMER_HIGH->CR1 = TIM_CR1_CEN;
+    SLEEP_TIMER->CR2 = TIM_CR2_MMS_1;
+
+    SLEEP_TIMER->CR1 = TIM_CR1_CEN;
+    NVIC_DisableIRQ(SLEEP_TIMER_IRQ);
+    NVIC_ClearPendingIRQ(SLEEP_TIMER_IRQ);
+    SCB->SCR |= SCB_SCR_SEVONPEND_Msk;
+}
+
+static inline void sleep_timer_wait(uint16_t us) {
+    // Drop the match of a previous wait before arming, so it can't end this one early and a short
+    // wait can't miss its own match
+    SLEEP_TIMER->SR = (uint16_t) ~TIM_SR_CC1IF;
+    NVIC_ClearPendingIRQ(SLEEP_TIMER_IRQ);
+    uint16_t start = SLEEP_TIMER->CNT;
+    SLEEP_TIMER->CCR1 = (uint16_t) (start + us);
+
+    // The elapsed count ends the wait too, in case the match went by before CCR1 was written
+    while (!(SLEEP_TIMER->SR & TIM_SR_CC1IF) && (uint16_t) (SLEEP_TIMER->CNT - start) < us) {
+        nrf24l01_hal_idle();
+
+        // A match right after the check still sets the event register, so WFE returns at once
+        if (!(SLEEP_TIMER->SR & TIM_SR_CC1IF) && (uint16_t) (SLEEP_TIMER->CNT - start) < us) {
+            __WFE();
+        }
+    }
+
+    // Clear the pending state so the next match raises a new event
+    SLEEP_TIMER->SR = (uint16_t) ~TIM_SR_CC1IF;
+    NVIC_ClearPendingIRQ(SLEEP_TIMER_IRQ);
+}
+
+NRF24L01_HAL_FUNCTION void nrf24l01_hal_sleep_us(uint32_t us) {
+    sleep_timer_init();
+    while (us > 0) {
+        uint32_t chunk = us > SLEEP_TIMER_MAX_CHUNK ? SLEEP_TIMER_MAX_CHUNK : us;
+        sleep_timer_wait(chunk);
+        us -= chunk;
+    }
+}
+
+NRF24L01_HAL_FUNCTION uint32_t nrf24l01_hal_get_us_ticks() {
+    sleep_timer_init();
+
+    // Read again if TIM2 overflowed in between. This needs no interrupt, so the clock keeps
+    // running inside critical sections.
+    uint16_t high, low;
+    do {
+        high = SLEEP_TIMER_HIGH->CNT;
+        low = SLEEP_TIMER->CNT;
+    } while (high != SLEEP_TIMER_HIGH->CNT);
+
+    return (uint32_t) high << 16 | low;
+}
+
+#ifdef NRF24L01_INSTRUMENTATION
+NRF24L01_HAL_FUNCTION uint32_t nrf24l01_hal_get_cycles() {
+    // Start the DWT cycle counter on first use
+    if (!(DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk)) {
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+    return DWT->CYCCNT;
+}
+#endif
@@ -1,16 +1,73 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "nrf24l01_hal.h"
 
 /**
- * SPI peripheral abstraction layer, used to communicate with the nRF24l01 device.
+ * Function called when an asynchronous command completes. May be called from interrupt context.
+ * @param context The context given when the command was started.
+ * @param status The value of the STATUS register captured during the command.
+ */
+typedef void (*spi_interface_callback)(void *context, uint8_t status);
+
+/**
+ * A command recorded in a spi_interface_queue, along with its result.
+ */
+typedef struct {
+    uint8_t command;
+    const uint8_t *data;
+    uint32_t data_length;
+    uint8_t *output;
+    uint32_t output_length;
+    uint8_t status; // The value of the STATUS register captured when the command ran
+} spi_interface_command;
+
+/**
+ * A sequence of commands that are sent to the device back to back in one pass.
  */
 typedef struct {
+    spi_interface_command *commands;
+    uint32_t capacity;
+    uint32_t count;
+} spi_interface_queue;
+
+struct spi_bus;
+
+/**
+ * STATUS reported for a command that was not sent, because the bus or the previous asynchronous
+ * command was not released in time (see NRF24L01_ASSERT). Bit 7 of the real STATUS always reads 0.
+ */
+#define SPI_INTERFACE_STATUS_FAILED 0xFF
+
+/**
+ * SPI peripheral abstraction layer, used to communicate with the nRF24l01 device.
+ */
+typedef struct spi_interface {
     void *spi;
     void *csn_port;
     uint16_t csn_pin;
     void *ce_port;
     uint16_t ce_pin;
+    bool ce_state; // Last value written to CE, as the pin is an output
+    void *irq_port; // NULL if the IRQ pin is not connected
+    uint16_t irq_pin;
+
+    // Shared bus the device is registered to (NULL if it owns the SPI peripheral)
+    struct spi_bus *bus;
+    uint32_t bus_settings;
+
+    // State of the asynchronous command in progress
+    volatile bool busy;
+    uint8_t async_status;
+    nrf24l01_hal_spi_segment async_segment;
+    spi_interface_callback async_callback;
+    void *async_context;
+#ifdef NRF24L01_INSTRUMENTATION
+    uint8_t async_command;
+    uint32_t async_start_cycles;
+#endif
 } spi_interface;
 
 /**
@@ -28,18 +85,142 @@ void spi_interface_init(
         uint16_t ce_pin);
 
 /**
- * Sends a command to the nRF24l01 device.
+ * Initializes the SPI interface abstraction layer for a device sharing the SPI peripheral of
+ * the given bus with other devices, and initializes the corresponding GPIO pins.
+ * @param self The spi_interface struct to initialize.
+ * @param bus The shared bus to register the device to. Must be initialized beforehand.
+ * @param bus_settings The SPI settings to apply whenever this device takes over the bus. Their
+ *                     meaning is defined by nrf24l01_hal_spi_configure.
+ * @param csn_port The CSN GPIO port.
+ * @param csn_pin The CSN GPIO pin.
+ * @param ce_port The CE GPIO port.
+ * @param ce_pin The CE GPIO pin.
+ * @return False if the bus has no room for another device, true otherwise.
+ */
+bool spi_interface_init_shared(
+        spi_interface *self, struct spi_bus *bus, uint32_t bus_settings, void *csn_port, uint16_t csn_pin,
+        void *ce_port, uint16_t ce_pin);
+
+/**
+ * Sets the GPIO connected to the active-low IRQ pin of the device.
+ * @param self The spi_interface struct to act upon.
+ * @param irq_port The IRQ GPIO port connected to the device, or NULL if not connected.
+ * @param irq_pin The IRQ GPIO pin connected to the device.
+ */
+void spi_interface_set_irq_pin(spi_interface *self, void *irq_port, uint16_t irq_pin);
+
+/**
+ * Sets the SPI clock to one of the steps of the port (see nrf24l01_hal_spi_set_clock_step). On a
+ * shared bus, the clock becomes the bus settings of the device, applied whenever it takes the bus.
+ * @param self The spi_interface struct to act upon.
+ * @param step The clock step to apply.
+ * @param frequency Pointer to a variable where the resulting clock frequency (Hz) will be stored.
+ * @return False if the step is not supported by the port, true otherwise.
+ */
+bool spi_interface_set_clock_step(spi_interface *self, uint32_t step, uint32_t *frequency);
+
+/**
+ * Waits for the IRQ pin to be asserted (low), without using the SPI bus.
+ * @param self The spi_interface struct to act upon.
+ * @param timeout_us The maximum number of microseconds to wait (UINT32_MAX to wait indefinitely).
+ * @return True if the IRQ pin is asserted, or if no IRQ pin is set, in which case the caller has
+ *         to read STATUS to find out. False if the timeout expired.
+ */
+bool spi_interface_wait_irq(spi_interface *self, uint32_t timeout_us);
+
+/**
+ * Sends a command to the nRF24l01 device. The STATUS register is shifted out by the device
+ * while the command byte is shifted in, so it is captured and returned for free. The data
+ * and output buffers are transferred in place, in the same CSN frame as the command byte.
  * @param self The spi_interface struct to act upon.
  * @param command The command byte to send.
  * @param data Pointer to the bytes to send after the command byte. Can be NULL if no data is to be sent.
  * @param data_length The number of bytes to send after the command byte. Can be 0 if no data is to be sent.
  * @param output Pointer to the buffer where the response bytes will be stored. Can be NULL if no response is needed.
  * @param output_length The number of bytes to read from the device. Can be 0 if no response is needed.
+ * @return The value of the STATUS register at the start of the transaction, or
+ *         SPI_INTERFACE_STATUS_FAILED if the command was not sent.
+ */
+uint8_t spi_interface_send_command(
+        spi_interface *self, uint8_t command, const uint8_t *data, uint32_t data_length, uint8_t *output,
+        uint32_t output_length);
+
+/**
+ * Initializes an empty command queue backed by the given array.
+ * @param self The spi_interface_queue struct to initialize.
+ * @param commands The array where the commands will be recorded.
+ * @param capacity The number of commands the array can hold.
+ */
+void spi_interface_queue_init(spi_interface_queue *self, spi_interface_command *commands, uint32_t capacity);
+
+/**
+ * Removes all commands from the queue.
+ * @param self The spi_interface_queue struct to act upon.
+ */
+void spi_interface_queue_clear(spi_interface_queue *self);
+
+/**
+ * Records a command at the end of the queue. The parameters have the same meaning as in
+ * spi_interface_send_command. The buffers must stay valid until the queue is run.
+ * @param self The spi_interface_queue struct to act upon.
+ * @param command The command byte to send.
+ * @param data Pointer to the bytes to send after the command byte. Can be NULL.
+ * @param data_length The number of bytes to send after the command byte.
+ * @param output Pointer to the buffer where the response bytes will be stored. Can be NULL.
+ * @param output_length The number of bytes to read from the device.
+ * @return False if the queue is full, true otherwise.
  */
-void spi_interface_send_command(
-        spi_interface *self, uint8_t command, uint8_t *data, uint32_t data_length, uint8_t *output,
+bool spi_interface_queue_add(
+        spi_interface_queue *self, uint8_t command, const uint8_t *data, uint32_t data_length, uint8_t *output,
         uint32_t output_length);
 
+/**
+ * Sends all the commands of the queue to the nRF24l01 device in order, each in its own CSN frame,
+ * without returning in between. The STATUS captured by each command is stored in its entry.
+ * @param self The spi_interface struct to act upon.
+ * @param queue The queue of commands to send.
+ * @return False if the queue was not sent, in which case every entry has the
+ *         SPI_INTERFACE_STATUS_FAILED status.
+ */
+bool spi_interface_run_queue(spi_interface *self, spi_interface_queue *queue);
+
+/**
+ * Starts sending a command to the nRF24l01 device and returns without waiting for the data or
+ * output bytes to be transferred. The command byte is sent immediately and the rest is handed to
+ * nrf24l01_hal_spi_transfer_async (ex. DMA), so the CPU is free while a payload is moved. CSN is
+ * released when the transfer completes. If the port cannot transfer asynchronously, the command
+ * is completed before returning. Waits for any previous asynchronous command to complete first.
+ * @param self The spi_interface struct to act upon.
+ * @param command The command byte to send.
+ * @param data Pointer to the bytes to send after the command byte. Must stay valid until the
+ *             command completes. Can be NULL if no data is to be sent.
+ * @param data_length The number of bytes to send after the command byte.
+ * @param output Pointer to the buffer where the response bytes will be stored. Must stay valid
+ *               until the command completes. Can be NULL if no response is needed.
+ * @param output_length The number of bytes to read from the device.
+ * @param callback Function to call when the command completes, or right away with
+ *                 SPI_INTERFACE_STATUS_FAILED if it could not be sent. Can be NULL.
+ * @param context Opaque pointer to pass to the callback.
+ */
+void spi_interface_send_command_async(
+        spi_interface *self, uint8_t command, const uint8_t *data, uint32_t data_length, uint8_t *output,
+        uint32_t output_length, spi_interface_callback callback, void *context);
+
+/**
+ * @param self The spi_interface struct to act upon.
+ * @return True if an asynchronous command is still in progress.
+ */
+bool spi_interface_is_busy(spi_interface *self);
+
+/**
+ * Blocks until the asynchronous command in progress, if any, completes, running the idle hook
+ * (see nrf24l01_hal_idle) meanwhile. Must not be called from an interrupt that may have preempted
+ * the completion of the command.
+ * @param self The spi_interface struct to act upon.
+ * @return False if the command did not complete in time (see NRF24L01_ASSERT), true otherwise.
+ */
+bool spi_interface_wait(spi_interface *self);
+
 /**
  * Toggles the CE pin for at least 10us (15us to be safe).
  * @param self The spi_interface struct to act upon.
@@ -57,3 +238,9 @@ void spi_interface_enable_ce(spi_interface *self);
  * @param self The spi_interface struct to act upon.
  */
 void spi_interface_disable_ce(spi_interface *self);
+
+/**
+ * @param self The spi_interface struct to act upon.
+ * @return True if the CE pin is high, false if it is low.
+ */
+bool spi_interface_get_ce(spi_interface *self);
@@ -2,17 +2,163 @@
 
 #include <stdio.h>
 
-void device_commands_init(device_commands *self, spi_interface *spi_handler) { self->spi_handler = spi_handler; }
+void device_commands_init(device_commands *self, spi_interface *spi_handler) {
+    self->spi_handler = spi_handler;
+    device_commands_invalidate_cache(self);
+}
+
+// Returns the slot of a register in the cache, or -1 if it is not cached
+static int device_commands_cache_index(uint8_t address) {
+    if (address <= REGISTER_ADDRESS_RF_SETUP) {
+        return address;
+    } else if (address == REGISTER_ADDRESS_DYNPD) {
+        return 7;
+    } else if (address == REGISTER_ADDRESS_FEATURE) {
+        return 8;
+    }
+    return -1;
+}
+
+static void device_commands_cache_store(device_commands *self, uint8_t address, uint8_t value) {
+    int index = device_commands_cache_index(address);
+    if (index >= 0) {
+        self->cache[index] = value;
+        self->cache_valid |= 1 << index;
+    }
+}
 
-static void
+static uint8_t
 device_commands_read_register(device_commands *self, uint8_t address, uint8_t *output, uint8_t output_length) {
     uint8_t command = COMMAND_CODE_R_REGISTER | address;
-    spi_interface_send_command(self->spi_handler, command, NULL, 0, output, output_length);
+    uint8_t status = spi_interface_send_command(self->spi_handler, command, NULL, 0, output, output_length);
+    if (output_length == 1 && status != SPI_INTERFACE_STATUS_FAILED) {
+        device_commands_cache_store(self, address, *output);
+    }
+    return status;
 }
 
-static void device_commands_write_register(device_commands *self, uint8_t address, uint8_t *data, uint8_t data_length) {
+static uint8_t device_commands_write_register(device_commands *self, uint8_t address, uint8_t *data, uint8_t data_length) {
     uint8_t command = COMMAND_CODE_W_REGISTER | address;
-    spi_interface_send_command(self->spi_handler, command, data, data_length, NULL, 0);
+    uint8_t status = spi_interface_send_command(self->spi_handler, command, data, data_length, NULL, 0);
+    if (data_length == 1 && status != SPI_INTERFACE_STATUS_FAILED) {
+        device_commands_cache_store(self, address, *data);
+    }
+    return status;
+}
+
+void device_commands_invalidate_cache(device_commands *self) { self->cache_valid = 0; }
+
+void device_commands_resync_cache(device_commands *self) {
+    static const uint8_t addresses[DEVICE_COMMANDS_CACHE_SIZE] = {
+        REGISTER_ADDRESS_CONFIG, REGISTER_ADDRESS_EN_AA, REGISTER_ADDRESS_EN_RXADDR, REGISTER_ADDRESS_SETUP_AW,
+        REGISTER_ADDRESS_SETUP_RETR, REGISTER_ADDRESS_RF_CH, REGISTER_ADDRESS_RF_SETUP, REGISTER_ADDRESS_DYNPD,
+        REGISTER_ADDRESS_FEATURE
+    };
+
+    spi_interface_command commands[DEVICE_COMMANDS_CACHE_SIZE];
+    spi_interface_queue queue;
+    spi_interface_queue_init(&queue, commands, DEVICE_COMMANDS_CACHE_SIZE);
+
+    uint8_t values[DEVICE_COMMANDS_CACHE_SIZE];
+    for (int i = 0; i < DEVICE_COMMANDS_CACHE_SIZE; i++) {
+        device_commands_queue_read_register(&queue, addresses[i], &values[i], 1);
+    }
+    device_commands_run_queue(self, &queue);
+}
+
+void device_commands_read_register_cached(device_commands *self, uint8_t address, uint8_t *value) {
+    int index = device_commands_cache_index(address);
+    if (index < 0 || !(self->cache_valid & (1 << index))) {
+        device_commands_read_register(self, address, value, 1);
+        return;
+    }
+
+    *value = self->cache[index];
+#ifdef NRF24L01_VERIFY_CACHE
+    // A register changed behind the cache, ex. by a power loss without a resync. The value of the
+    // device is used if the assertion doesn't stop the program.
+    uint8_t actual;
+    device_commands_read_register(self, address, &actual, 1);
+    NRF24L01_ASSERT(actual == *value);
+    *value = actual;
+#endif
+}
+
+bool device_commands_run_queue(device_commands *self, spi_interface_queue *queue) {
+    if (!spi_interface_run_queue(self->spi_handler, queue)) {
+        return false;
+    }
+
+    // Keep the cache in line with the single byte register accesses of the queue
+    for (uint32_t i = 0; i < queue->count; i++) {
+        spi_interface_command *command = &queue->commands[i];
+        if (command->command < COMMAND_CODE_W_REGISTER && command->output_length == 1) {
+            device_commands_cache_store(self, command->command, *command->output);
+        } else if (command->command < 0x40 && command->data_length == 1) {
+            device_commands_cache_store(self, command->command & 0x1F, *command->data);
+        }
+    }
+    return true;
+}
+
+bool device_commands_queue_read_register(
+        spi_interface_queue *queue, uint8_t address, uint8_t *output, uint8_t output_length) {
+    uint8_t command = COMMAND_CODE_R_REGISTER | address;
+    return spi_interface_queue_add(queue, command, NULL, 0, output, output_length);
+}
+
+bool device_commands_queue_write_register(
+        spi_interface_queue *queue, uint8_t address, const uint8_t *data, uint8_t data_length) {
+    uint8_t command = COMMAND_CODE_W_REGISTER | address;
+    return spi_interface_queue_add(queue, command, data, data_length, NULL, 0);
+}
+
+bool device_commands_queue_w_tx_payload(spi_interface_queue *queue, const uint8_t *payload, uint32_t payload_length) {
+    return spi_interface_queue_add(queue, COMMAND_CODE_W_TX_PAYLOAD, payload, payload_length, NULL, 0);
+}
+
+void device_commands_update_begin(device_commands_register_update *update, uint8_t address) {
+    update->address = address;
+    update->mask = 0;
+    update->bits = 0;
+}
+
+void device_commands_update_field(
+        device_commands_register_update *update, device_commands_field field, uint32_t pipe, uint8_t value) {
+    uint8_t mask = device_commands_field_mask(field, pipe);
+    update->mask |= mask;
+    update->bits = (update->bits & ~mask) | ((value << device_commands_field_offset(field, pipe)) & mask);
+}
+
+uint8_t device_commands_read_masked(device_commands *self, uint8_t address, uint8_t mask, uint8_t *value) {
+    uint8_t register_value;
+    uint8_t status = device_commands_read_register(self, address, &register_value, 1);
+    *value = register_value & mask;
+    return status;
+}
+
+uint8_t device_commands_write_masked(device_commands *self, uint8_t address, uint8_t mask, uint8_t bits) {
+    uint8_t register_value;
+    device_commands_read_register_cached(self, address, &register_value);
+    register_value = (register_value & ~mask) | (bits & mask);
+    return device_commands_write_register(self, address, &register_value, 1);
+}
+
+// Computes the new register value out of the current one and the staged fields
+static void device_commands_update_apply(device_commands *self, device_commands_register_update *update) {
+    uint8_t current;
+    device_commands_read_register_cached(self, update->address, &current);
+    update->value = (current & ~update->mask) | update->bits;
+}
+
+uint8_t device_commands_update_commit(device_commands *self, device_commands_register_update *update) {
+    return device_commands_write_masked(self, update->address, update->mask, update->bits);
+}
+
+bool device_commands_queue_update(
+        device_commands *self, spi_interface_queue *queue, device_commands_register_update *update) {
+    device_commands_update_apply(self, update);
+    return device_commands_queue_write_register(queue, update->address, &update->value, 1);
 }
 
 void device_commands_pulse_ce(device_commands *self) { spi_interface_pulse_ce(self->spi_handler); }
@@ -23,297 +169,355 @@ void device_commands_disable_ce(device_commands *self) { spi_interface_disable_c
 
 // Commands
 
-void device_commands_flush_tx(device_commands *self) {
-    spi_interface_send_command(self->spi_handler, COMMAND_CODE_FLUSH_TX, NULL, 0, NULL, 0);
+uint8_t device_commands_flush_tx(device_commands *self) {
+    return spi_interface_send_command(self->spi_handler, COMMAND_CODE_FLUSH_TX, NULL, 0, NULL, 0);
+}
+
+uint8_t device_commands_flush_rx(device_commands *self) {
+    return spi_interface_send_command(self->spi_handler, COMMAND_CODE_FLUSH_RX, NULL, 0, NULL, 0);
+}
+
+uint8_t device_commands_reuse_tx_pl(device_commands *self) {
+    return spi_interface_send_command(self->spi_handler, COMMAND_CODE_REUSE_TX_PL, NULL, 0, NULL, 0);
+}
+
+uint8_t device_commands_w_tx_payload(device_commands *self, uint8_t *payload, uint32_t payload_length) {
+    return spi_interface_send_command(self->spi_handler, COMMAND_CODE_W_TX_PAYLOAD, payload, payload_length, NULL, 0);
+}
+
+uint8_t device_commands_w_tx_payload_no_ack(device_commands *self, uint8_t *payload, uint32_t payload_length) {
+    return spi_interface_send_command(self->spi_handler, COMMAND_CODE_W_TX_PAYLOAD_NO_ACK, payload, payload_length, NULL, 0);
+}
+
+uint8_t device_commands_w_ack_payload(device_commands *self, uint32_t pipe, uint8_t *payload, uint32_t payload_length) {
+    return spi_interface_send_command(
+            self->spi_handler, COMMAND_CODE_W_ACK_PAYLOAD | pipe, payload, payload_length, NULL, 0);
 }
 
-void device_commands_flush_rx(device_commands *self) {
-    spi_interface_send_command(self->spi_handler, COMMAND_CODE_FLUSH_RX, NULL, 0, NULL, 0);
+uint8_t device_commands_r_rx_payload(device_commands *self, uint8_t *output, uint32_t output_length) {
+    return spi_interface_send_command(self->spi_handler, COMMAND_CODE_R_RX_PAYLOAD, NULL, 0, output, output_length);
 }
 
-void device_commands_w_tx_payload(device_commands *self, uint8_t *payload, uint32_t payload_length) {
-    spi_interface_send_command(self->spi_handler, COMMAND_CODE_W_TX_PAYLOAD, payload, payload_length, NULL, 0);
+void device_commands_w_tx_payload_async(
+        device_commands *self, uint8_t *payload, uint32_t payload_length, spi_interface_callback callback,
+        void *context) {
+    spi_interface_send_command_async(
+            self->spi_handler, COMMAND_CODE_W_TX_PAYLOAD, payload, payload_length, NULL, 0, callback, context);
 }
 
-void device_commands_w_tx_payload_no_ack(device_commands *self, uint8_t *payload, uint32_t payload_length) {
-    spi_interface_send_command(self->spi_handler, COMMAND_CODE_W_TX_PAYLOAD_NO_ACK, payload, payload_length, NULL, 0);
+void device_commands_w_tx_payload_no_ack_async(
+        device_commands *self, uint8_t *payload, uint32_t payload_length, spi_interface_callback callback,
+        void *context) {
+    spi_interface_send_command_async(
+            self->spi_handler, COMMAND_CODE_W_TX_PAYLOAD_NO_ACK, payload, payload_length, NULL, 0, callback,
+            context);
 }
 
-void device_commands_r_rx_payload(device_commands *self, uint8_t *output, uint32_t output_length) {
-    spi_interface_send_command(self->spi_handler, COMMAND_CODE_R_RX_PAYLOAD, NULL, 0, output, output_length);
+void device_commands_r_rx_payload_async(
+        device_commands *self, uint8_t *output, uint32_t output_length, spi_interface_callback callback,
+        void *context) {
+    spi_interface_send_command_async(
+            self->spi_handler, COMMAND_CODE_R_RX_PAYLOAD, NULL, 0, output, output_length, callback, context);
 }
 
-void device_commands_r_rx_pl_wid(device_commands *self, uint8_t *output) {
-    spi_interface_send_command(self->spi_handler, COMMAND_CODE_R_RX_PL_WID, NULL, 0, output, 1);
+uint8_t device_commands_nop(device_commands *self) {
+    return spi_interface_send_command(self->spi_handler, COMMAND_CODE_NOP, NULL, 0, NULL, 0);
+}
+
+uint8_t device_commands_r_rx_pl_wid(device_commands *self, uint8_t *output) {
+    return spi_interface_send_command(self->spi_handler, COMMAND_CODE_R_RX_PL_WID, NULL, 0, output, 1);
 }
 
 // Registers
 
-void device_commands_get_crco(device_commands *self, bool *value) {
-    uint8_t config_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_CONFIG, &config_register, 1);
-    *value = (config_register >> 2) & 0x01;
+// Reads a single bit field into a bool
+static uint8_t device_commands_get_flag(device_commands *self, device_commands_field field, uint32_t pipe, bool *value) {
+    uint8_t field_value;
+    uint8_t status = device_commands_get_field(self, field, pipe, &field_value);
+    *value = field_value;
+    return status;
 }
 
-void device_commands_set_crco(device_commands *self, bool value) {
-    uint8_t config_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_CONFIG, &config_register, 1);
-    config_register = (config_register & 0xFB) | (value << 2);
-    device_commands_write_register(self, REGISTER_ADDRESS_CONFIG, &config_register, 1);
+uint8_t device_commands_get_mask_rx_dr(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_MASK_RX_DR, 0, value);
 }
 
-void device_commands_get_pwr_up(device_commands *self, bool *value) {
-    uint8_t config_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_CONFIG, &config_register, 1);
-    *value = (config_register >> 1) & 0x01;
+uint8_t device_commands_set_mask_rx_dr(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_MASK_RX_DR, 0, value);
 }
 
-void device_commands_set_pwr_up(device_commands *self, bool value) {
-    uint8_t config_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_CONFIG, &config_register, 1);
-    config_register = (config_register & 0xFD) | (value << 1);
-    device_commands_write_register(self, REGISTER_ADDRESS_CONFIG, &config_register, 1);
+uint8_t device_commands_get_mask_tx_ds(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_MASK_TX_DS, 0, value);
 }
 
-void device_commands_get_prim_rx(device_commands *self, bool *value) {
-    uint8_t config_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_CONFIG, &config_register, 1);
-    *value = config_register & 0x01;
+uint8_t device_commands_set_mask_tx_ds(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_MASK_TX_DS, 0, value);
 }
 
-void device_commands_set_prim_rx(device_commands *self, bool value) {
-    uint8_t config_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_CONFIG, &config_register, 1);
-    config_register = (config_register & 0xFE) | value;
-    device_commands_write_register(self, REGISTER_ADDRESS_CONFIG, &config_register, 1);
+uint8_t device_commands_get_mask_max_rt(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_MASK_MAX_RT, 0, value);
 }
 
-void device_commands_get_erx(device_commands *self, uint32_t pipe, bool *value) {
-    uint8_t en_rxaddr_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_EN_RXADDR, &en_rxaddr_register, 1);
-    *value = (en_rxaddr_register >> pipe) & 0x01;
+uint8_t device_commands_set_mask_max_rt(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_MASK_MAX_RT, 0, value);
 }
 
-void device_commands_set_erx(device_commands *self, uint32_t pipe, bool value) {
-    uint8_t en_rxaddr_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_EN_RXADDR, &en_rxaddr_register, 1);
-    en_rxaddr_register = (en_rxaddr_register & (~(1 << pipe))) | (value << pipe);
-    device_commands_write_register(self, REGISTER_ADDRESS_EN_RXADDR, &en_rxaddr_register, 1);
+uint8_t device_commands_get_crco(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_CRCO, 0, value);
 }
 
-void device_commands_get_ard(device_commands *self, uint8_t *value) {
-    uint8_t setup_retr_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_SETUP_RETR, &setup_retr_register, 1);
-    *value = (setup_retr_register >> 4) & 0x0F;
+uint8_t device_commands_set_crco(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_CRCO, 0, value);
 }
 
-void device_commands_set_ard(device_commands *self, uint8_t value) {
-    uint8_t setup_retr_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_SETUP_RETR, &setup_retr_register, 1);
-    setup_retr_register = (setup_retr_register & 0x0F) | (value << 4);
-    device_commands_write_register(self, REGISTER_ADDRESS_SETUP_RETR, &setup_retr_register, 1);
+uint8_t device_commands_get_pwr_up(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_PWR_UP, 0, value);
 }
 
-void device_commands_get_arc(device_commands *self, uint8_t *value) {
-    uint8_t setup_retr_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_SETUP_RETR, &setup_retr_register, 1);
-    *value = setup_retr_register & 0x0F;
+uint8_t device_commands_set_pwr_up(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_PWR_UP, 0, value);
 }
 
-void device_commands_set_arc(device_commands *self, uint8_t value) {
-    uint8_t setup_retr_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_SETUP_RETR, &setup_retr_register, 1);
-    setup_retr_register = (setup_retr_register & 0xF0) | value;
-    device_commands_write_register(self, REGISTER_ADDRESS_SETUP_RETR, &setup_retr_register, 1);
+uint8_t device_commands_get_prim_rx(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_PRIM_RX, 0, value);
 }
 
-void device_commands_get_rf_ch(device_commands *self, uint8_t *value) {
-    uint8_t rf_ch_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_RF_CH, &rf_ch_register, 1);
-    *value = rf_ch_register & 0x7F;
+uint8_t device_commands_set_prim_rx(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_PRIM_RX, 0, value);
 }
 
-void device_commands_set_rf_ch(device_commands *self, uint8_t value) {
-    uint8_t rf_ch_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_RF_CH, &rf_ch_register, 1);
-    rf_ch_register = (rf_ch_register & 0x80) | value;
-    device_commands_write_register(self, REGISTER_ADDRESS_RF_CH, &rf_ch_register, 1);
+uint8_t device_commands_get_enaa(device_commands *self, uint32_t pipe, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_ENAA, pipe, value);
 }
 
-void device_commands_get_rf_dr_low(device_commands *self, bool *value) {
-    uint8_t rf_setup_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_RF_SETUP, &rf_setup_register, 1);
-    *value = (rf_setup_register >> 5) & 0x01;
+uint8_t device_commands_set_enaa(device_commands *self, uint32_t pipe, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_ENAA, pipe, value);
 }
 
-void device_commands_set_rf_dr_low(device_commands *self, bool value) {
-    uint8_t rf_setup_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_RF_SETUP, &rf_setup_register, 1);
-    rf_setup_register = (rf_setup_register & 0xDF) | (value << 5);
-    device_commands_write_register(self, REGISTER_ADDRESS_RF_SETUP, &rf_setup_register, 1);
+uint8_t device_commands_get_erx(device_commands *self, uint32_t pipe, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_ERX, pipe, value);
 }
 
-void device_commands_get_rf_dr_high(device_commands *self, bool *value) {
-    uint8_t rf_setup_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_RF_SETUP, &rf_setup_register, 1);
-    *value = (rf_setup_register >> 3) & 0x01;
+uint8_t device_commands_set_erx(device_commands *self, uint32_t pipe, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_ERX, pipe, value);
 }
 
-void device_commands_set_rf_dr_high(device_commands *self, bool value) {
-    uint8_t rf_setup_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_RF_SETUP, &rf_setup_register, 1);
-    rf_setup_register = (rf_setup_register & 0xF7) | (value << 3);
-    device_commands_write_register(self, REGISTER_ADDRESS_RF_SETUP, &rf_setup_register, 1);
+uint8_t device_commands_get_aw(device_commands *self, uint8_t *value) {
+    return device_commands_get_field(self, DEVICE_COMMANDS_FIELD_AW, 0, value);
 }
 
-void device_commands_get_rf_pwr(device_commands *self, uint8_t *value) {
-    uint8_t rf_setup_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_RF_SETUP, &rf_setup_register, 1);
-    *value = (rf_setup_register >> 1) & 0x03;
+uint8_t device_commands_set_aw(device_commands *self, uint8_t value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_AW, 0, value);
 }
 
-void device_commands_set_rf_pwr(device_commands *self, uint8_t value) {
-    uint8_t rf_setup_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_RF_SETUP, &rf_setup_register, 1);
-    rf_setup_register = (rf_setup_register & 0xF9) | (value << 1);
-    device_commands_write_register(self, REGISTER_ADDRESS_RF_SETUP, &rf_setup_register, 1);
+uint8_t device_commands_get_address_width(device_commands *self) {
+    uint8_t setup_aw;
+    device_commands_read_register_cached(self, REGISTER_ADDRESS_SETUP_AW, &setup_aw);
+    return (setup_aw & device_commands_field_mask(DEVICE_COMMANDS_FIELD_AW, 0)) + 2;
 }
 
-void device_commands_get_rx_dr(device_commands *self, bool *value) {
-    uint8_t status_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
-    *value = (status_register >> 6) & 0x01;
+uint8_t device_commands_get_ard(device_commands *self, uint8_t *value) {
+    return device_commands_get_field(self, DEVICE_COMMANDS_FIELD_ARD, 0, value);
 }
 
-void device_commands_clear_rx_dr(device_commands *self) {
-    uint8_t status_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
-    status_register |= 0x40;
-    device_commands_write_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
+uint8_t device_commands_set_ard(device_commands *self, uint8_t value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_ARD, 0, value);
 }
 
-void device_commands_get_tx_ds(device_commands *self, bool *value) {
-    uint8_t status_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
-    *value = (status_register >> 5) & 0x01;
+uint8_t device_commands_get_arc(device_commands *self, uint8_t *value) {
+    return device_commands_get_field(self, DEVICE_COMMANDS_FIELD_ARC, 0, value);
 }
 
-void device_commands_clear_tx_ds(device_commands *self) {
-    uint8_t status_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
-    status_register |= 0x20;
-    device_commands_write_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
+uint8_t device_commands_set_arc(device_commands *self, uint8_t value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_ARC, 0, value);
 }
 
-void device_commands_get_max_rt(device_commands *self, bool *value) {
-    uint8_t status_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
-    *value = (status_register >> 4) & 0x01;
+uint8_t device_commands_get_rf_ch(device_commands *self, uint8_t *value) {
+    return device_commands_get_field(self, DEVICE_COMMANDS_FIELD_RF_CH, 0, value);
 }
 
-void device_commands_clear_max_rt(device_commands *self) {
-    uint8_t status_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
-    status_register |= 0x10;
-    device_commands_write_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
+uint8_t device_commands_set_rf_ch(device_commands *self, uint8_t value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_RF_CH, 0, value);
 }
 
-void device_commands_get_rx_addr_full(device_commands *self, uint32_t pipe, uint8_t *value) {
+uint8_t device_commands_get_rf_dr_low(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_RF_DR_LOW, 0, value);
+}
+
+uint8_t device_commands_set_rf_dr_low(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_RF_DR_LOW, 0, value);
+}
+
+uint8_t device_commands_get_rf_dr_high(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_RF_DR_HIGH, 0, value);
+}
+
+uint8_t device_commands_set_rf_dr_high(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_RF_DR_HIGH, 0, value);
+}
+
+uint8_t device_commands_get_rf_pwr(device_commands *self, uint8_t *value) {
+    return device_commands_get_field(self, DEVICE_COMMANDS_FIELD_RF_PWR, 0, value);
+}
+
+uint8_t device_commands_set_rf_pwr(device_commands *self, uint8_t value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_RF_PWR, 0, value);
+}
+
+uint8_t device_commands_get_status(device_commands *self, device_commands_status *value) {
+    uint8_t status = device_commands_nop(self);
+    device_commands_decode_status(status, value);
+    return status;
+}
+
+uint8_t device_commands_clear_status(device_commands *self, uint8_t mask) {
+    // Writing 0 to a flag leaves it as is, so no need to read STATUS first
+    uint8_t status_register = mask & STATUS_MASK_EVENTS;
+    return device_commands_write_register(self, REGISTER_ADDRESS_STATUS, &status_register, 1);
+}
+
+uint8_t device_commands_get_rx_dr(device_commands *self, bool *value) {
+    uint8_t status = device_commands_nop(self);
+    *value = (status & STATUS_MASK_RX_DR) != 0;
+    return status;
+}
+
+uint8_t device_commands_clear_rx_dr(device_commands *self) {
+    return device_commands_clear_status(self, STATUS_MASK_RX_DR);
+}
+
+uint8_t device_commands_get_tx_ds(device_commands *self, bool *value) {
+    uint8_t status = device_commands_nop(self);
+    *value = (status & STATUS_MASK_TX_DS) != 0;
+    return status;
+}
+
+uint8_t device_commands_clear_tx_ds(device_commands *self) {
+    return device_commands_clear_status(self, STATUS_MASK_TX_DS);
+}
+
+uint8_t device_commands_get_max_rt(device_commands *self, bool *value) {
+    uint8_t status = device_commands_nop(self);
+    *value = (status & STATUS_MASK_MAX_RT) != 0;
+    return status;
+}
+
+uint8_t device_commands_clear_max_rt(device_commands *self) {
+    return device_commands_clear_status(self, STATUS_MASK_MAX_RT);
+}
+
+uint8_t device_commands_get_arc_cnt(device_commands *self, uint8_t *value) {
+    return device_commands_get_field(self, DEVICE_COMMANDS_FIELD_ARC_CNT, 0, value);
+}
+
+uint8_t device_commands_get_plos_cnt(device_commands *self, uint8_t *value) {
+    return device_commands_get_field(self, DEVICE_COMMANDS_FIELD_PLOS_CNT, 0, value);
+}
+
+uint8_t device_commands_get_rpd(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_RPD, 0, value);
+}
+
+uint8_t device_commands_get_rx_addr_full(device_commands *self, uint32_t pipe, uint8_t *value) {
     uint8_t address = REGISTER_ADDRESS_RX_ADDR_P0 + pipe;
-    device_commands_read_register(self, address, value, 5);
+    return device_commands_read_register(self, address, value, device_commands_get_address_width(self));
 }
 
-void device_commands_set_rx_addr_full(device_commands *self, uint32_t pipe, uint8_t *value) {
+uint8_t device_commands_set_rx_addr_full(device_commands *self, uint32_t pipe, uint8_t *value) {
     uint8_t address = REGISTER_ADDRESS_RX_ADDR_P0 + pipe;
-    device_commands_write_register(self, address, value, 5);
+    return device_commands_write_register(self, address, value, device_commands_get_address_width(self));
 }
 
-void device_commands_get_rx_addr_lsb(device_commands *self, uint32_t pipe, uint8_t *value) {
+uint8_t device_commands_get_rx_addr_lsb(device_commands *self, uint32_t pipe, uint8_t *value) {
     uint8_t address = REGISTER_ADDRESS_RX_ADDR_P0 + pipe;
     uint8_t rx_addr_register_lsb;
-    device_commands_read_register(self, address, &rx_addr_register_lsb, 1);
+    uint8_t status = device_commands_read_register(self, address, &rx_addr_register_lsb, 1);
     *value = rx_addr_register_lsb;
+    return status;
 }
 
-void device_commands_set_rx_addr_lsb(device_commands *self, uint32_t pipe, uint8_t value) {
+uint8_t device_commands_set_rx_addr_lsb(device_commands *self, uint32_t pipe, uint8_t value) {
     uint8_t address = REGISTER_ADDRESS_RX_ADDR_P0 + pipe;
-    device_commands_write_register(self, address, &value, 1);
+    return device_commands_write_register(self, address, &value, 1);
 }
 
-void device_commands_get_tx_addr_full(device_commands *self, uint8_t *value) {
-    device_commands_read_register(self, REGISTER_ADDRESS_TX_ADDR, value, 5);
+uint8_t device_commands_get_tx_addr_full(device_commands *self, uint8_t *value) {
+    return device_commands_read_register(
+            self, REGISTER_ADDRESS_TX_ADDR, value, device_commands_get_address_width(self));
 }
 
-void device_commands_set_tx_addr_full(device_commands *self, uint8_t *value) {
-    device_commands_write_register(self, REGISTER_ADDRESS_TX_ADDR, value, 5);
+uint8_t device_commands_set_tx_addr_full(device_commands *self, uint8_t *value) {
+    return device_commands_write_register(
+            self, REGISTER_ADDRESS_TX_ADDR, value, device_commands_get_address_width(self));
 }
 
-void device_commands_get_tx_addr_lsb(device_commands *self, uint8_t *value) {
+uint8_t device_commands_get_tx_addr_lsb(device_commands *self, uint8_t *value) {
     uint8_t tx_addr_register_lsb;
-    device_commands_read_register(self, REGISTER_ADDRESS_TX_ADDR, &tx_addr_register_lsb, 1);
+    uint8_t status = device_commands_read_register(self, REGISTER_ADDRESS_TX_ADDR, &tx_addr_register_lsb, 1);
     *value = tx_addr_register_lsb;
+    return status;
+}
+
+uint8_t device_commands_set_tx_addr_lsb(device_commands *self, uint8_t value) {
+    return device_commands_write_register(self, REGISTER_ADDRESS_TX_ADDR, &value, 1);
+}
+
+// RX_PW_Px are separate registers, one per pipe
+static device_commands_field device_commands_rx_pw_field(uint32_t pipe) {
+    return DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_RX_PW_P0 + pipe, 0, 6, 0);
+}
+
+uint8_t device_commands_get_rx_pw(device_commands *self, uint32_t pipe, uint8_t *value) {
+    return device_commands_get_field(self, device_commands_rx_pw_field(pipe), 0, value);
+}
+
+uint8_t device_commands_set_rx_pw(device_commands *self, uint32_t pipe, uint8_t value) {
+    return device_commands_set_field(self, device_commands_rx_pw_field(pipe), 0, value);
 }
 
-void device_commands_set_tx_addr_lsb(device_commands *self, uint8_t value) {
-    device_commands_write_register(self, REGISTER_ADDRESS_TX_ADDR, &value, 1);
+uint8_t device_commands_get_rx_empty(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_RX_EMPTY, 0, value);
 }
 
-void device_commands_get_rx_pw(device_commands *self, uint32_t pipe, uint8_t *value) {
-    uint8_t address = REGISTER_ADDRESS_RX_PW_P0 + pipe;
-    uint8_t rx_pw_register;
-    device_commands_read_register(self, address, &rx_pw_register, 1);
-    *value = rx_pw_register & 0x3F;
+uint8_t device_commands_get_fifo_status(device_commands *self, device_commands_fifo_status *value) {
+    uint8_t fifo_status;
+    uint8_t status = device_commands_read_register(self, REGISTER_ADDRESS_FIFO_STATUS, &fifo_status, 1);
+    value->rx_empty = (fifo_status & FIFO_STATUS_MASK_RX_EMPTY) != 0;
+    value->rx_full = (fifo_status & FIFO_STATUS_MASK_RX_FULL) != 0;
+    value->tx_empty = (fifo_status & FIFO_STATUS_MASK_TX_EMPTY) != 0;
+    value->tx_full = (fifo_status & FIFO_STATUS_MASK_TX_FULL) != 0;
+    value->tx_reuse = (fifo_status & FIFO_STATUS_MASK_TX_REUSE) != 0;
+    return status;
 }
 
-void device_commands_set_rx_pw(device_commands *self, uint32_t pipe, uint8_t value) {
-    uint8_t address = REGISTER_ADDRESS_RX_PW_P0 + pipe;
-    uint8_t rx_pw_register;
-    device_commands_read_register(self, address, &rx_pw_register, 1);
-    rx_pw_register = (rx_pw_register & 0xC0) | value;
-    device_commands_write_register(self, address, &rx_pw_register, 1);
+uint8_t device_commands_get_dpl(device_commands *self, uint32_t pipe, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_DPL, pipe, value);
 }
 
-void device_commands_get_rx_empty(device_commands *self, bool *value) {
-    uint8_t fifo_status_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_FIFO_STATUS, &fifo_status_register, 1);
-    *value = fifo_status_register & 0x01;
+uint8_t device_commands_set_dpl(device_commands *self, uint32_t pipe, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_DPL, pipe, value);
 }
 
-void device_commands_get_dpl(device_commands *self, uint32_t pipe, bool *value) {
-    uint8_t dynpd_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_DYNPD, &dynpd_register, 1);
-    *value = (dynpd_register >> pipe) & 0x01;
+uint8_t device_commands_get_en_dpl(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_EN_DPL, 0, value);
 }
 
-void device_commands_set_dpl(device_commands *self, uint32_t pipe, bool value) {
-    uint8_t dynpd_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_DYNPD, &dynpd_register, 1);
-    dynpd_register = (dynpd_register & (~(1 << pipe))) | (value << pipe);
-    device_commands_write_register(self, REGISTER_ADDRESS_DYNPD, &dynpd_register, 1);
+uint8_t device_commands_set_en_dpl(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_EN_DPL, 0, value);
 }
 
-void device_commands_get_en_dpl(device_commands *self, bool *value) {
-    uint8_t feature_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_FEATURE, &feature_register, 1);
-    *value = (feature_register >> 2) & 0x01;
+uint8_t device_commands_get_en_dyn_ack(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_EN_DYN_ACK, 0, value);
 }
 
-void device_commands_set_en_dpl(device_commands *self, bool value) {
-    uint8_t feature_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_FEATURE, &feature_register, 1);
-    feature_register = (feature_register & 0xFB) | (value << 2);
-    device_commands_write_register(self, REGISTER_ADDRESS_FEATURE, &feature_register, 1);
+uint8_t device_commands_set_en_dyn_ack(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_EN_DYN_ACK, 0, value);
 }
 
-void device_commands_get_en_dyn_ack(device_commands *self, bool *value) {
-    uint8_t feature_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_FEATURE, &feature_register, 1);
-    *value = feature_register & 0x01;
+uint8_t device_commands_get_en_ack_pay(device_commands *self, bool *value) {
+    return device_commands_get_flag(self, DEVICE_COMMANDS_FIELD_EN_ACK_PAY, 0, value);
 }
 
-void device_commands_set_en_dyn_ack(device_commands *self, bool value) {
-    uint8_t feature_register;
-    device_commands_read_register(self, REGISTER_ADDRESS_FEATURE, &feature_register, 1);
-    feature_register = (feature_register & 0xFE) | value;
-    device_commands_write_register(self, REGISTER_ADDRESS_FEATURE, &feature_register, 1);
+uint8_t device_commands_set_en_ack_pay(device_commands *self, bool value) {
+    return device_commands_set_field(self, DEVICE_COMMANDS_FIELD_EN_ACK_PAY, 0, value);
 }
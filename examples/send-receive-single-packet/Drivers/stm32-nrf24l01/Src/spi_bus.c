@@ -0,0 +1,121 @@
+#include "spi_bus.h"
+
+#include <stddef.h>
+
+#include "nrf24l01_hal.h"
+
+void spi_bus_init(spi_bus *self, void *spi) {
+    self->spi = spi;
+    self->locked = false;
+    self->owner = NULL;
+    self->device_count = 0;
+    self->next_device = 0;
+}
+
+bool spi_bus_register(spi_bus *self, spi_interface *device) {
+    if (self->device_count == SPI_BUS_MAX_DEVICES) {
+        return false;
+    }
+
+    self->pending[self->device_count] = NULL;
+    self->devices[self->device_count++] = device;
+    return true;
+}
+
+bool spi_bus_try_acquire(spi_bus *self, spi_interface *device) {
+    uint32_t state = nrf24l01_hal_enter_critical();
+    bool acquired = !self->locked;
+    self->locked = true;
+    nrf24l01_hal_exit_critical(state);
+
+    if (!acquired) {
+        return false;
+    }
+
+    // Apply the SPI settings of the device if another device used the bus last
+    if (self->owner != device) {
+        nrf24l01_hal_spi_configure(self->spi, device->bus_settings);
+        self->owner = device;
+    }
+    return true;
+}
+
+bool spi_bus_acquire(spi_bus *self, spi_interface *device, uint32_t timeout_us) {
+    uint32_t start = nrf24l01_hal_get_us_ticks();
+    while (!spi_bus_try_acquire(self, device)) {
+        if (timeout_us != UINT32_MAX && nrf24l01_hal_elapsed_us(start) >= timeout_us) {
+            return false;
+        }
+        nrf24l01_hal_idle();
+    }
+    return true;
+}
+
+void spi_bus_release(spi_bus *self, spi_interface *device) {
+    // The owner only changes when the bus is acquired, so it is the device holding a locked bus
+    if (self->owner == device) {
+        self->locked = false;
+    }
+}
+
+static int spi_bus_find_device(spi_bus *self, spi_interface *device) {
+    for (uint32_t i = 0; i < self->device_count; i++) {
+        if (self->devices[i] == device) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool spi_bus_submit(spi_bus *self, spi_interface *device, spi_interface_queue *queue) {
+    int index = spi_bus_find_device(self, device);
+    if (index < 0) {
+        return false;
+    }
+
+    uint32_t state = nrf24l01_hal_enter_critical();
+    bool free = self->pending[index] == NULL;
+    if (free) {
+        self->pending[index] = queue;
+    }
+    nrf24l01_hal_exit_critical(state);
+
+    return free;
+}
+
+bool spi_bus_is_pending(spi_bus *self, spi_interface_queue *queue) {
+    for (uint32_t i = 0; i < self->device_count; i++) {
+        if (self->pending[i] == queue) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t spi_bus_run(spi_bus *self) {
+    uint32_t run_count = 0;
+
+    // Keep going around the devices until a whole round finds nothing to do
+    uint32_t idle_devices = 0;
+    while (idle_devices < self->device_count) {
+        uint32_t index = self->next_device;
+        self->next_device = (index + 1) % self->device_count;
+
+        spi_interface_queue *queue = self->pending[index];
+        if (queue == NULL) {
+            idle_devices++;
+            continue;
+        }
+
+        // A queue that couldn't be sent stays pending for the next run
+        if (!spi_interface_run_queue(self->devices[index], queue)) {
+            idle_devices++;
+            continue;
+        }
+        self->pending[index] = NULL;
+        run_count++;
+        idle_devices = 0;
+    }
+
+    return run_count;
+}
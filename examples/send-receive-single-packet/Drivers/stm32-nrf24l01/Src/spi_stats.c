@@ -0,0 +1,118 @@
+#include "spi_stats.h"
+
+#ifdef NRF24L01_INSTRUMENTATION
+
+#include <stdio.h>
+
+static spi_stats_entry entries[SPI_STATS_MAX_COMMANDS];
+static uint32_t entry_count = 0;
+static uint32_t dropped = 0;
+
+static spi_stats_entry *spi_stats_find(uint8_t command) {
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if (entries[i].command == command) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t spi_stats_bucket(uint32_t cycles) {
+    uint32_t bucket = 0;
+    for (cycles >>= SPI_STATS_HISTOGRAM_MIN_BITS; cycles > 0 && bucket < SPI_STATS_HISTOGRAM_BUCKETS - 1; cycles >>= 1) {
+        bucket++;
+    }
+    return bucket;
+}
+
+void spi_stats_record(uint8_t command, uint32_t bytes, uint32_t cycles) {
+    // Asynchronous transfers are recorded from their completion interrupt
+    uint32_t state = nrf24l01_hal_enter_critical();
+
+    spi_stats_entry *entry = spi_stats_find(command);
+    if (entry == NULL) {
+        if (entry_count == SPI_STATS_MAX_COMMANDS) {
+            dropped++;
+            nrf24l01_hal_exit_critical(state);
+            return;
+        }
+
+        entry = &entries[entry_count++];
+        *entry = (spi_stats_entry) { command, 0, UINT32_MAX, 0, 0, 0, { 0 } };
+    }
+
+    entry->count++;
+    entry->total_cycles += cycles;
+    entry->total_bytes += bytes;
+    if (cycles < entry->min_cycles) {
+        entry->min_cycles = cycles;
+    }
+    if (cycles > entry->max_cycles) {
+        entry->max_cycles = cycles;
+    }
+    entry->histogram[spi_stats_bucket(cycles)]++;
+
+    nrf24l01_hal_exit_critical(state);
+}
+
+const spi_stats_entry *spi_stats_get(uint8_t command) { return spi_stats_find(command); }
+
+uint32_t spi_stats_dropped() { return dropped; }
+
+void spi_stats_reset() {
+    uint32_t state = nrf24l01_hal_enter_critical();
+    entry_count = 0;
+    dropped = 0;
+    nrf24l01_hal_exit_critical(state);
+}
+
+// Register accesses are shown along with the register address
+static void spi_stats_name(uint8_t command, char *name, uint32_t size) {
+    if (command < 0x20) {
+        snprintf(name, size, "R_REGISTER %02X", command);
+    } else if (command < 0x40) {
+        snprintf(name, size, "W_REGISTER %02X", command & 0x1F);
+    } else {
+        snprintf(name, size, "CMD %02X", command);
+    }
+}
+
+void spi_stats_dump() {
+    printf("command           count       min      mean       max     bytes\r\n");
+    for (uint32_t i = 0; i < entry_count; i++) {
+        spi_stats_entry *entry = &entries[i];
+        char name[16];
+        spi_stats_name(entry->command, name, sizeof(name));
+
+        uint32_t mean = entry->total_cycles / entry->count;
+        printf("%-14s %8lu %9lu %9lu %9lu %9lu\r\n", name, (unsigned long) entry->count,
+               (unsigned long) entry->min_cycles, (unsigned long) mean, (unsigned long) entry->max_cycles,
+               (unsigned long) entry->total_bytes);
+    }
+    if (dropped > 0) {
+        printf("%lu transactions of untracked commands\r\n", (unsigned long) dropped);
+    }
+
+    // Histograms, each bucket shown with the upper bound of its durations
+    printf("\r\ncommand        transactions by duration (cycles)\r\n");
+    for (uint32_t i = 0; i < entry_count; i++) {
+        spi_stats_entry *entry = &entries[i];
+        char name[16];
+        spi_stats_name(entry->command, name, sizeof(name));
+
+        printf("%-14s", name);
+        for (uint32_t bucket = 0; bucket < SPI_STATS_HISTOGRAM_BUCKETS; bucket++) {
+            if (entry->histogram[bucket] == 0) {
+                continue;
+            }
+            if (bucket < SPI_STATS_HISTOGRAM_BUCKETS - 1) {
+                printf(" <%lu: %lu", 1UL << (SPI_STATS_HISTOGRAM_MIN_BITS + bucket), (unsigned long) entry->histogram[bucket]);
+            } else {
+                printf(" more: %lu", (unsigned long) entry->histogram[bucket]);
+            }
+        }
+        printf("\r\n");
+    }
+}
+
+#endif
@@ -11,10 +11,13 @@ typedef enum {
     COMMAND_CODE_W_REGISTER = 0x20,
     COMMAND_CODE_R_RX_PAYLOAD = 0x61,
     COMMAND_CODE_W_TX_PAYLOAD = 0xA0,
+    COMMAND_CODE_W_ACK_PAYLOAD = 0xA8,
     COMMAND_CODE_FLUSH_TX = 0xE1,
     COMMAND_CODE_FLUSH_RX = 0xE2,
+    COMMAND_CODE_REUSE_TX_PL = 0xE3,
     COMMAND_CODE_W_TX_PAYLOAD_NO_ACK = 0xB0,
     COMMAND_CODE_R_RX_PL_WID = 0x60,
+    COMMAND_CODE_NOP = 0xFF,
 } CommandCode;
 
 /**
@@ -22,11 +25,15 @@ typedef enum {
  */
 typedef enum {
     REGISTER_ADDRESS_CONFIG = 0x00,
+    REGISTER_ADDRESS_EN_AA = 0x01,
     REGISTER_ADDRESS_EN_RXADDR = 0x02,
+    REGISTER_ADDRESS_SETUP_AW = 0x03,
     REGISTER_ADDRESS_SETUP_RETR = 0x04,
     REGISTER_ADDRESS_RF_CH = 0x05,
     REGISTER_ADDRESS_RF_SETUP = 0x06,
     REGISTER_ADDRESS_STATUS = 0x07,
+    REGISTER_ADDRESS_OBSERVE_TX = 0x08,
+    REGISTER_ADDRESS_RPD = 0x09,
     REGISTER_ADDRESS_RX_ADDR_P0 = 0x0A,
     REGISTER_ADDRESS_TX_ADDR = 0x10,
     REGISTER_ADDRESS_RX_PW_P0 = 0x11,
@@ -35,11 +42,111 @@ typedef enum {
     REGISTER_ADDRESS_FEATURE = 0x1D,
 } RegisterAddress;
 
+/**
+ * Bit masks of the fields in the STATUS register. RX_P_NO reads as all ones
+ * (STATUS_MASK_RX_P_NO) when the RX FIFO is empty.
+ */
+typedef enum {
+    STATUS_MASK_TX_FULL = 0x01,
+    STATUS_MASK_RX_P_NO = 0x0E,
+    STATUS_MASK_MAX_RT = 0x10,
+    STATUS_MASK_TX_DS = 0x20,
+    STATUS_MASK_RX_DR = 0x40,
+    STATUS_MASK_EVENTS = STATUS_MASK_RX_DR | STATUS_MASK_TX_DS | STATUS_MASK_MAX_RT,
+} StatusMask;
+
+/**
+ * Bit masks of the fields in the FIFO_STATUS register.
+ */
+typedef enum {
+    FIFO_STATUS_MASK_RX_EMPTY = 0x01,
+    FIFO_STATUS_MASK_RX_FULL = 0x02,
+    FIFO_STATUS_MASK_TX_EMPTY = 0x10,
+    FIFO_STATUS_MASK_TX_FULL = 0x20,
+    FIFO_STATUS_MASK_TX_REUSE = 0x40,
+} FifoStatusMask;
+
+/**
+ * Fields of the STATUS register, as captured by a single command.
+ */
+typedef struct {
+    bool rx_dr;      // A payload arrived in the RX FIFO
+    bool tx_ds;      // A packet was sent (and acknowledged if auto acknowledgement is on)
+    bool max_rt;     // A packet was retransmitted the maximum number of times without ACK
+    uint8_t rx_p_no; // Pipe of the payload at the head of the RX FIFO, 7 if the RX FIFO is empty
+    bool tx_full;    // The TX FIFO is full
+} device_commands_status;
+
+/**
+ * Fields of the FIFO_STATUS register.
+ */
+typedef struct {
+    bool rx_empty;
+    bool rx_full;
+    bool tx_empty;
+    bool tx_full;
+    bool tx_reuse;   // The last payload is resent while CE is high (REUSE_TX_PL)
+} device_commands_fifo_status;
+
+/**
+ * Location of a field in a register. Fields repeated for every pipe (ex. ERX_Px) start at offset
+ * for pipe 0 and move by stride bits for each following pipe.
+ */
+typedef struct {
+    uint8_t address; // The register holding the field
+    uint8_t offset;  // The position of the lowest bit of the field
+    uint8_t width;   // The number of bits of the field
+    uint8_t stride;  // The distance in bits between the fields of consecutive pipes (0 if not per pipe)
+} device_commands_field;
+
+#define DEVICE_COMMANDS_FIELD(address, offset, width, stride) \
+    ((device_commands_field) { (address), (offset), (width), (stride) })
+
+/**
+ * Descriptors of the fields of the registers. As constants, the accesses through them compile
+ * down to a single masked read or write.
+ */
+#define DEVICE_COMMANDS_FIELD_PRIM_RX DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_CONFIG, 0, 1, 0)
+#define DEVICE_COMMANDS_FIELD_PWR_UP DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_CONFIG, 1, 1, 0)
+#define DEVICE_COMMANDS_FIELD_CRCO DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_CONFIG, 2, 1, 0)
+#define DEVICE_COMMANDS_FIELD_MASK_MAX_RT DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_CONFIG, 4, 1, 0)
+#define DEVICE_COMMANDS_FIELD_MASK_TX_DS DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_CONFIG, 5, 1, 0)
+#define DEVICE_COMMANDS_FIELD_MASK_RX_DR DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_CONFIG, 6, 1, 0)
+#define DEVICE_COMMANDS_FIELD_ENAA DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_EN_AA, 0, 1, 1)
+#define DEVICE_COMMANDS_FIELD_ERX DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_EN_RXADDR, 0, 1, 1)
+#define DEVICE_COMMANDS_FIELD_AW DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_SETUP_AW, 0, 2, 0)
+#define DEVICE_COMMANDS_FIELD_ARC DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_SETUP_RETR, 0, 4, 0)
+#define DEVICE_COMMANDS_FIELD_ARD DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_SETUP_RETR, 4, 4, 0)
+#define DEVICE_COMMANDS_FIELD_RF_CH DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_RF_CH, 0, 7, 0)
+#define DEVICE_COMMANDS_FIELD_RF_PWR DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_RF_SETUP, 1, 2, 0)
+#define DEVICE_COMMANDS_FIELD_RF_DR_HIGH DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_RF_SETUP, 3, 1, 0)
+#define DEVICE_COMMANDS_FIELD_RF_DR_LOW DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_RF_SETUP, 5, 1, 0)
+#define DEVICE_COMMANDS_FIELD_ARC_CNT DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_OBSERVE_TX, 0, 4, 0)
+#define DEVICE_COMMANDS_FIELD_PLOS_CNT DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_OBSERVE_TX, 4, 4, 0)
+#define DEVICE_COMMANDS_FIELD_RPD DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_RPD, 0, 1, 0)
+#define DEVICE_COMMANDS_FIELD_RX_EMPTY DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_FIFO_STATUS, 0, 1, 0)
+#define DEVICE_COMMANDS_FIELD_DPL DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_DYNPD, 0, 1, 1)
+#define DEVICE_COMMANDS_FIELD_EN_DYN_ACK DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_FEATURE, 0, 1, 0)
+#define DEVICE_COMMANDS_FIELD_EN_ACK_PAY DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_FEATURE, 1, 1, 0)
+#define DEVICE_COMMANDS_FIELD_EN_DPL DEVICE_COMMANDS_FIELD(REGISTER_ADDRESS_FEATURE, 2, 1, 0)
+
+/**
+ * Number of registers kept in the register cache: CONFIG, EN_AA, EN_RXADDR, SETUP_AW, SETUP_RETR,
+ * RF_CH, RF_SETUP, DYNPD and FEATURE.
+ */
+#define DEVICE_COMMANDS_CACHE_SIZE 9
+
 /**
  * Struct used to interact with the nrf24l01 device through commands
  */
 typedef struct {
     spi_interface *spi_handler;
+
+    // Shadow copies of the configuration registers. The device only changes them when they are
+    // written, so the setters don't need to read them first. Define NRF24L01_VERIFY_CACHE to check
+    // every cached value against the device with NRF24L01_ASSERT (debugging).
+    uint8_t cache[DEVICE_COMMANDS_CACHE_SIZE];
+    uint16_t cache_valid; // One bit per cached register
 } device_commands;
 
 /**
@@ -50,6 +157,172 @@ typedef struct {
  */
 void device_commands_init(device_commands *self, spi_interface *spi_handler);
 
+/**
+ * Forgets all cached register values, so they are read from the device the next time they are
+ * needed. Must be called if the device lost power, as its registers are back to their reset values.
+ * @param self Pointer to the device_commands struct to use.
+ */
+void device_commands_invalidate_cache(device_commands *self);
+
+/**
+ * Reads all cached registers from the device in one pass.
+ * @param self Pointer to the device_commands struct to use.
+ */
+void device_commands_resync_cache(device_commands *self);
+
+/**
+ * Gets the value of a register from the cache. Reads it from the device if it is not cached.
+ * @param self Pointer to the device_commands struct to use.
+ * @param address The address of the register (single byte).
+ * @param value Pointer to a variable where the value will be stored.
+ */
+void device_commands_read_register_cached(device_commands *self, uint8_t address, uint8_t *value);
+
+/**
+ * Sends all the commands recorded in the queue back to back, see spi_interface_run_queue.
+ * Register values read or written by the queue update the cache.
+ * @param self Pointer to the device_commands struct to use.
+ * @param queue The queue of commands to send.
+ * @return False if the queue was not sent (the cache is then left as is), true otherwise.
+ */
+bool device_commands_run_queue(device_commands *self, spi_interface_queue *queue);
+
+/**
+ * Records a register read in the queue.
+ * @param queue The queue to record the command in.
+ * @param address The address of the register to read.
+ * @param output Pointer to the buffer where the register value will be stored when the queue runs.
+ * @param output_length The number of bytes to read.
+ * @return False if the queue is full, true otherwise.
+ */
+bool device_commands_queue_read_register(
+        spi_interface_queue *queue, uint8_t address, uint8_t *output, uint8_t output_length);
+
+/**
+ * Records a register write in the queue.
+ * @param queue The queue to record the command in.
+ * @param address The address of the register to write.
+ * @param data Pointer to the bytes to write. Must stay valid until the queue runs.
+ * @param data_length The number of bytes to write.
+ * @return False if the queue is full, true otherwise.
+ */
+bool device_commands_queue_write_register(
+        spi_interface_queue *queue, uint8_t address, const uint8_t *data, uint8_t data_length);
+
+/**
+ * Records a TX payload write, requesting an acknowledgment, in the queue.
+ * @param queue The queue to record the command in.
+ * @param payload Pointer to the array of bytes to send. Must stay valid until the queue runs.
+ * @param payload_length Length of the data to send in bytes.
+ * @return False if the queue is full, true otherwise.
+ */
+bool device_commands_queue_w_tx_payload(spi_interface_queue *queue, const uint8_t *payload, uint32_t payload_length);
+
+/**
+ * Changes to several fields of one register, staged with device_commands_update_field and applied
+ * together with a single write, so the register never holds a mix of old and new fields.
+ */
+typedef struct {
+    uint8_t address; // The register to update
+    uint8_t mask;    // The bits changed by the staged fields
+    uint8_t bits;    // The new value of the changed bits
+    uint8_t value;   // The resulting register value, computed when the update is applied
+} device_commands_register_update;
+
+/**
+ * Starts an update of the specified register with no changes staged.
+ * @param update Pointer to the update to initialize.
+ * @param address The address of the register (single byte).
+ */
+void device_commands_update_begin(device_commands_register_update *update, uint8_t address);
+
+/**
+ * Stages a new value for a field of the register.
+ * @param update Pointer to the update to act upon.
+ * @param field The field to change. Must belong to the register of the update.
+ * @param pipe The pipe of the field (0 if the field is not per pipe).
+ * @param value The new value of the field.
+ */
+void device_commands_update_field(
+        device_commands_register_update *update, device_commands_field field, uint32_t pipe, uint8_t value);
+
+/**
+ * Applies the staged fields to the current register value (taken from the cache) and writes it.
+ * @param self Pointer to the device_commands struct to use.
+ * @param update Pointer to the update to apply.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_update_commit(device_commands *self, device_commands_register_update *update);
+
+/**
+ * Applies the staged fields to the current register value (taken from the cache) and records
+ * the write in the queue, to apply changes to several registers in one pass.
+ * @param self Pointer to the device_commands struct to use.
+ * @param queue The queue to record the command in.
+ * @param update Pointer to the update to apply. Must stay valid until the queue runs.
+ * @return False if the queue is full, true otherwise.
+ */
+bool device_commands_queue_update(
+        device_commands *self, spi_interface_queue *queue, device_commands_register_update *update);
+
+/**
+ * Reads a register and keeps only the specified bits.
+ * @param self Pointer to the device_commands struct to use.
+ * @param address The address of the register (single byte).
+ * @param mask The bits to keep.
+ * @param value Pointer to a variable where the masked value will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_read_masked(device_commands *self, uint8_t address, uint8_t mask, uint8_t *value);
+
+/**
+ * Replaces the specified bits of a register, keeping the others at their cached value.
+ * @param self Pointer to the device_commands struct to use.
+ * @param address The address of the register (single byte).
+ * @param mask The bits to replace.
+ * @param bits The new value of the replaced bits.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_write_masked(device_commands *self, uint8_t address, uint8_t mask, uint8_t bits);
+
+static inline uint8_t device_commands_field_offset(device_commands_field field, uint32_t pipe) {
+    return field.offset + pipe * field.stride;
+}
+
+static inline uint8_t device_commands_field_mask(device_commands_field field, uint32_t pipe) {
+    return ((1 << field.width) - 1) << device_commands_field_offset(field, pipe);
+}
+
+/**
+ * Reads the value of a field from the device.
+ * @param self Pointer to the device_commands struct to use.
+ * @param field The field to read. Ex. DEVICE_COMMANDS_FIELD_RF_CH
+ * @param pipe The pipe of the field (0 if the field is not per pipe).
+ * @param value Pointer to a variable where the value of the field will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+static inline uint8_t
+device_commands_get_field(device_commands *self, device_commands_field field, uint32_t pipe, uint8_t *value) {
+    uint8_t bits;
+    uint8_t status = device_commands_read_masked(self, field.address, device_commands_field_mask(field, pipe), &bits);
+    *value = bits >> device_commands_field_offset(field, pipe);
+    return status;
+}
+
+/**
+ * Writes the value of a field to the device, with a single write.
+ * @param self Pointer to the device_commands struct to use.
+ * @param field The field to write. Ex. DEVICE_COMMANDS_FIELD_RF_CH
+ * @param pipe The pipe of the field (0 if the field is not per pipe).
+ * @param value The new value of the field.
+ * @return The value of the STATUS register captured during the command.
+ */
+static inline uint8_t
+device_commands_set_field(device_commands *self, device_commands_field field, uint32_t pipe, uint8_t value) {
+    uint8_t offset = device_commands_field_offset(field, pipe);
+    return device_commands_write_masked(self, field.address, device_commands_field_mask(field, pipe), value << offset);
+}
+
 /**
  * Pulses the CE pin of the SPI interface to trigger certain actions on the nrf24l01 device.
  * @param self Pointer to the spi_interface struct to use.
@@ -73,30 +346,53 @@ void spi_interface_disable_ce(spi_interface *self);
 /**
  * Removes all data from the TX FIFO.
  * @param self Pointer to the device_commands struct to use.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_flush_tx(device_commands *self);
+uint8_t device_commands_flush_tx(device_commands *self);
 
 /**
  * Removes all data from the RX FIFO.
  * @param self Pointer to the device_commands struct to use.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_flush_rx(device_commands *self);
+
+/**
+ * Keeps the last transmitted payload in the TX FIFO, so it is sent again on every CE pulse without
+ * being rewritten. Active until the next W_TX_PAYLOAD or FLUSH_TX.
+ * @param self Pointer to the device_commands struct to use.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_flush_rx(device_commands *self);
+uint8_t device_commands_reuse_tx_pl(device_commands *self);
 
 /**
  * Queues the given payload for transmission, requesting an acknowledgment.
  * @param self Pointer to the device_commands struct to use.
  * @param payload Pointer to the array of bytes to send.
  * @param payload_length Length of the data to send in bytes.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_w_tx_payload(device_commands *self, uint8_t *payload, uint32_t payload_length);
+uint8_t device_commands_w_tx_payload(device_commands *self, uint8_t *payload, uint32_t payload_length);
 
 /**
  * Queues the given payload for transmission without requesting an acknowledgment.
  * @param self Pointer to the device_commands struct to use.
  * @param payload Pointer to the array of bytes to send.
  * @param payload_length Length of the data to send in bytes.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_w_tx_payload_no_ack(device_commands *self, uint8_t *payload, uint32_t payload_length);
+
+/**
+ * Queues the given payload to be sent back with the next acknowledgment on the specified pipe
+ * (RX mode). Requires EN_ACK_PAY and dynamic payload length. Up to 3 payloads can be pending.
+ * @param self Pointer to the device_commands struct to use.
+ * @param pipe The data pipe number (0-5).
+ * @param payload Pointer to the array of bytes to send.
+ * @param payload_length Length of the data to send in bytes.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_w_tx_payload_no_ack(device_commands *self, uint8_t *payload, uint32_t payload_length);
+uint8_t device_commands_w_ack_payload(device_commands *self, uint32_t pipe, uint8_t *payload, uint32_t payload_length);
 
 /**
  * Reads the received payload from the head of the RX FIFO into the provided output buffer.
@@ -104,322 +400,591 @@ void device_commands_w_tx_payload_no_ack(device_commands *self, uint8_t *payload
  * @param self Pointer to the device_commands struct to use.
  * @param output Pointer to the array of bytes where the received data will be stored.
  * @param output_length Length of the data to read in bytes.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_r_rx_payload(device_commands *self, uint8_t *output, uint32_t output_length);
+
+/**
+ * Starts queueing the given payload for transmission, requesting an acknowledgment, without
+ * waiting for the payload bytes to be transferred. See spi_interface_send_command_async.
+ * @param self Pointer to the device_commands struct to use.
+ * @param payload Pointer to the array of bytes to send. Must stay valid until the callback.
+ * @param payload_length Length of the data to send in bytes.
+ * @param callback Function to call when the payload has been transferred. Can be NULL.
+ * @param context Opaque pointer to pass to the callback.
+ */
+void device_commands_w_tx_payload_async(
+        device_commands *self, uint8_t *payload, uint32_t payload_length, spi_interface_callback callback,
+        void *context);
+
+/**
+ * Starts queueing the given payload for transmission without requesting an acknowledgment,
+ * without waiting for the payload bytes to be transferred. See spi_interface_send_command_async.
+ * @param self Pointer to the device_commands struct to use.
+ * @param payload Pointer to the array of bytes to send. Must stay valid until the callback.
+ * @param payload_length Length of the data to send in bytes.
+ * @param callback Function to call when the payload has been transferred. Can be NULL.
+ * @param context Opaque pointer to pass to the callback.
+ */
+void device_commands_w_tx_payload_no_ack_async(
+        device_commands *self, uint8_t *payload, uint32_t payload_length, spi_interface_callback callback,
+        void *context);
+
+/**
+ * Starts reading the received payload from the head of the RX FIFO into the provided output
+ * buffer without waiting for the payload bytes to be transferred. The payload is removed from
+ * the RX FIFO. See spi_interface_send_command_async.
+ * @param self Pointer to the device_commands struct to use.
+ * @param output Pointer to the array of bytes where the received data will be stored. Must stay
+ *               valid until the callback.
+ * @param output_length Length of the data to read in bytes.
+ * @param callback Function to call when the payload has been transferred. Can be NULL.
+ * @param context Opaque pointer to pass to the callback.
  */
-void device_commands_r_rx_payload(device_commands *self, uint8_t *output, uint32_t output_length);
+void device_commands_r_rx_payload_async(
+        device_commands *self, uint8_t *output, uint32_t output_length, spi_interface_callback callback,
+        void *context);
+
+/**
+ * Does nothing except for reading the STATUS register, which makes it the cheapest way
+ * to poll the device (single byte transaction).
+ * @param self Pointer to the device_commands struct to use.
+ * @return The value of the STATUS register.
+ */
+uint8_t device_commands_nop(device_commands *self);
 
 /**
  * Reads the width of the payload at the head of the RX FIFO.
  * @param self Pointer to the device_commands struct to use.
  * @param output Pointer to a variable where the payload width will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_r_rx_pl_wid(device_commands *self, uint8_t *output);
+uint8_t device_commands_r_rx_pl_wid(device_commands *self, uint8_t *output);
 
 // Registers
 
+/**
+ * Gets the value of MASK_RX_DR from the CONFIG register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a variable where the MASK_RX_DR value will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_mask_rx_dr(device_commands *self, bool *value);
+
+/**
+ * Sets the value of MASK_RX_DR in the CONFIG register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value true to keep RX_DR off the IRQ pin, false to let it assert the pin.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_set_mask_rx_dr(device_commands *self, bool value);
+
+/**
+ * Gets the value of MASK_TX_DS from the CONFIG register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a variable where the MASK_TX_DS value will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_mask_tx_ds(device_commands *self, bool *value);
+
+/**
+ * Sets the value of MASK_TX_DS in the CONFIG register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value true to keep TX_DS off the IRQ pin, false to let it assert the pin.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_set_mask_tx_ds(device_commands *self, bool value);
+
+/**
+ * Gets the value of MASK_MAX_RT from the CONFIG register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a variable where the MASK_MAX_RT value will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_mask_max_rt(device_commands *self, bool *value);
+
+/**
+ * Sets the value of MASK_MAX_RT in the CONFIG register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value true to keep MAX_RT off the IRQ pin, false to let it assert the pin.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_set_mask_max_rt(device_commands *self, bool value);
+
 /**
  * Gets the value of CRCO from the CONFIG register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the CRCO value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_crco(device_commands *self, bool *value);
+uint8_t device_commands_get_crco(device_commands *self, bool *value);
 
 /**
  * Sets the value of CRCO in the CONFIG register.
  * @param self Pointer to the device_commands struct to use.
  * @param value true for 2 bytes, false for 1 byte.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_crco(device_commands *self, bool value);
+uint8_t device_commands_set_crco(device_commands *self, bool value);
 
 /**
  * Gets the value of PWR_UP from the CONFIG register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the PWR_UP value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_pwr_up(device_commands *self, bool *value);
+uint8_t device_commands_get_pwr_up(device_commands *self, bool *value);
 
 /**
  * Sets the value of PWR_UP in the CONFIG register.
  * @param self Pointer to the device_commands struct to use.
  * @param value true to power up, false to power down.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_pwr_up(device_commands *self, bool value);
+uint8_t device_commands_set_pwr_up(device_commands *self, bool value);
 
 /**
  * Gets the value of PRIM_RX from the CONFIG register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the PRIM_RX value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_prim_rx(device_commands *self, bool *value);
+uint8_t device_commands_get_prim_rx(device_commands *self, bool *value);
 
 /**
  * Sets the value of PRIM_RX in the CONFIG register.
  * @param self Pointer to the device_commands struct to use.
  * @param value true for RX mode, false for TX mode.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_set_prim_rx(device_commands *self, bool value);
+
+/**
+ * Gets the value of ENAA_Px from the EN_AA register for the specified pipe x.
+ * @param self Pointer to the device_commands struct to use.
+ * @param pipe The data pipe number (0-5).
+ * @param value Pointer to a variable where the ENAA_Px value will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_enaa(device_commands *self, uint32_t pipe, bool *value);
+
+/**
+ * Sets the value of ENAA_Px in the EN_AA register for the specified pipe x.
+ * @param self Pointer to the device_commands struct to use.
+ * @param pipe The data pipe number (0-5).
+ * @param value true to enable, false to disable.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_prim_rx(device_commands *self, bool value);
+uint8_t device_commands_set_enaa(device_commands *self, uint32_t pipe, bool value);
 
 /**
  * Gets the value of ERX_Px from the EN_RXADDR register for the specified pipe x.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
  * @param value Pointer to a variable where the ERX_Px value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_erx(device_commands *self, uint32_t pipe, bool *value);
+uint8_t device_commands_get_erx(device_commands *self, uint32_t pipe, bool *value);
 
 /**
  * Sets the value of ERX_Px in the EN_RXADDR register for the specified pipe x.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
  * @param value true to enable, false to disable.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_set_erx(device_commands *self, uint32_t pipe, bool value);
+
+/**
+ * Gets the value of AW from the SETUP_AW register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a variable where the AW value will be stored (1-3 for 3-5 bytes).
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_aw(device_commands *self, uint8_t *value);
+
+/**
+ * Sets the value of AW in the SETUP_AW register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value The AW value (1-3 for 3-5 bytes).
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_set_aw(device_commands *self, uint8_t value);
+
+/**
+ * Gets the width of the RX/TX addresses from the cached SETUP_AW register.
+ * @param self Pointer to the device_commands struct to use.
+ * @return The address width in bytes (3-5).
  */
-void device_commands_set_erx(device_commands *self, uint32_t pipe, bool value);
+uint8_t device_commands_get_address_width(device_commands *self);
 
 /**
  * Gets the value of ARD from the SETUP_RETR register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the ARD value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_ard(device_commands *self, uint8_t *value);
+uint8_t device_commands_get_ard(device_commands *self, uint8_t *value);
 
 /**
  * Sets the value of ARD in the SETUP_RETR register.
  * @param self Pointer to the device_commands struct to use.
  * @param value The ARD value (0-15).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_ard(device_commands *self, uint8_t value);
+uint8_t device_commands_set_ard(device_commands *self, uint8_t value);
 
 /**
  * Gets the value of ARC from the SETUP_RETR register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the ARC value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_arc(device_commands *self, uint8_t *value);
+uint8_t device_commands_get_arc(device_commands *self, uint8_t *value);
 
 /**
  * Sets the value of ARC in the SETUP_RETR register.
  * @param self Pointer to the device_commands struct to use.
  * @param value The ARC value (0-15).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_arc(device_commands *self, uint8_t value);
+uint8_t device_commands_set_arc(device_commands *self, uint8_t value);
 
 /**
  * Gets the value of RF_CH from the RF_CH register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the RF_CH value will be stored (0-125).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_rf_ch(device_commands *self, uint8_t *value);
+uint8_t device_commands_get_rf_ch(device_commands *self, uint8_t *value);
 
 /**
  * Sets the value of RF_CH in the RF_CH register.
  * @param self Pointer to the device_commands struct to use.
  * @param value The RF_CH value (0-125).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_rf_ch(device_commands *self, uint8_t value);
+uint8_t device_commands_set_rf_ch(device_commands *self, uint8_t value);
 
 /**
  * Gets the value of RF_DR_LOW from the RF_SETUP register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the RF_DR_LOW value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_rf_dr_low(device_commands *self, bool *value);
+uint8_t device_commands_get_rf_dr_low(device_commands *self, bool *value);
 
 /**
  * Sets the value of RF_DR_LOW in the RF_SETUP register.
  * @param self Pointer to the device_commands struct to use.
  * @param value The RF_DR_LOW value
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_rf_dr_low(device_commands *self, bool value);
+uint8_t device_commands_set_rf_dr_low(device_commands *self, bool value);
 
 /**
  * Gets the value of RF_DR_HIGH from the RF_SETUP register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the RF_DR_HIGH value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_rf_dr_high(device_commands *self, bool *value);
+uint8_t device_commands_get_rf_dr_high(device_commands *self, bool *value);
 
 /**
  * Sets the value of RF_DR_HIGH in the RF_SETUP register.
  * @param self Pointer to the device_commands struct to use.
  * @param value The RF_DR_HIGH value
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_rf_dr_high(device_commands *self, bool value);
+uint8_t device_commands_set_rf_dr_high(device_commands *self, bool value);
 
 /**
  * Gets the value of RF_PWR from the RF_SETUP register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the RF_PWR value will be stored (0-3).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_rf_pwr(device_commands *self, uint8_t *value);
+uint8_t device_commands_get_rf_pwr(device_commands *self, uint8_t *value);
 
 /**
  * Sets the value of RF_PWR in the RF_SETUP register.
  * @param self Pointer to the device_commands struct to use.
  * @param value The RF_PWR value (0-3).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_rf_pwr(device_commands *self, uint8_t value);
+uint8_t device_commands_set_rf_pwr(device_commands *self, uint8_t value);
+
+/**
+ * Splits a STATUS value, as returned by every command, into its fields.
+ * @param status The value of the STATUS register.
+ * @param value Pointer to a struct where the fields will be stored.
+ */
+static inline void device_commands_decode_status(uint8_t status, device_commands_status *value) {
+    value->rx_dr = (status & STATUS_MASK_RX_DR) != 0;
+    value->tx_ds = (status & STATUS_MASK_TX_DS) != 0;
+    value->max_rt = (status & STATUS_MASK_MAX_RT) != 0;
+    value->rx_p_no = (status & STATUS_MASK_RX_P_NO) >> 1;
+    value->tx_full = (status & STATUS_MASK_TX_FULL) != 0;
+}
+
+/**
+ * Gets all the fields of the STATUS register at once, with a single NOP.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a struct where the fields will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_status(device_commands *self, device_commands_status *value);
+
+/**
+ * Clears the given event flags (STATUS_MASK_RX_DR, STATUS_MASK_TX_DS and/or STATUS_MASK_MAX_RT) in
+ * the STATUS register. The flags are cleared by writing 1 to them, so this is a single write
+ * without reading STATUS first, and the flags not in the mask are left untouched.
+ * @param self Pointer to the device_commands struct to use.
+ * @param mask The flags to clear, other bits are ignored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_clear_status(device_commands *self, uint8_t mask);
 
 /**
  * Gets the value of RX_DR from the STATUS register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the RX_DR value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_rx_dr(device_commands *self, bool *value);
+uint8_t device_commands_get_rx_dr(device_commands *self, bool *value);
 
 /**
  * Clears the RX_DR bit in the STATUS register by writing 1 to it.
  * @param self Pointer to the device_commands struct to use.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_clear_rx_dr(device_commands *self);
+uint8_t device_commands_clear_rx_dr(device_commands *self);
 
 /**
  * Gets the value of TX_DS from the STATUS register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the TX_DS value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_tx_ds(device_commands *self, bool *value);
+uint8_t device_commands_get_tx_ds(device_commands *self, bool *value);
 
 /**
  * Clears the TX_DS bit in the STATUS register by writing 1 to it.
  * @param self Pointer to the device_commands struct to use.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_clear_tx_ds(device_commands *self);
+uint8_t device_commands_clear_tx_ds(device_commands *self);
 
 /**
  * Gets the value of MAX_RT from the STATUS register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the MAX_RT value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_max_rt(device_commands *self, bool *value);
+uint8_t device_commands_get_max_rt(device_commands *self, bool *value);
 
 /**
  * Clears the MAX_RT bit in the STATUS register by writing 1 to it.
  * @param self Pointer to the device_commands struct to use.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_clear_max_rt(device_commands *self);
+uint8_t device_commands_clear_max_rt(device_commands *self);
 
 /**
- * Gets the full 5-byte RX_ADDR_Px address for the specified data pipe.
+ * Gets the value of ARC_CNT from the OBSERVE_TX register: the number of times the last packet was
+ * retransmitted. The device resets it when the next packet starts.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a variable where the ARC_CNT value will be stored (0-15).
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_arc_cnt(device_commands *self, uint8_t *value);
+
+/**
+ * Gets the value of PLOS_CNT from the OBSERVE_TX register: the number of packets lost (MAX_RT)
+ * since the last RF_CH write. Stops counting at 15.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a variable where the PLOS_CNT value will be stored (0-15).
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_plos_cnt(device_commands *self, uint8_t *value);
+
+/**
+ * Gets the value of RPD (Received Power Detector): whether a signal stronger than -64 dBm was
+ * present on the channel. Latched when CE goes low, after at least 170 us in RX mode.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a variable where the RPD value will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_rpd(device_commands *self, bool *value);
+
+/**
+ * Gets the full RX_ADDR_Px address for the specified data pipe.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
- * @param value Pointer to an array where the 5-byte address will be stored.
+ * @param value Pointer to an array where the address will be stored (address width bytes,
+ *              see device_commands_get_address_width).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_rx_addr_full(device_commands *self, uint32_t pipe, uint8_t *value);
+uint8_t device_commands_get_rx_addr_full(device_commands *self, uint32_t pipe, uint8_t *value);
 
 /**
- * Sets the full 5-byte RX_ADDR_Px address for the specified data pipe.
+ * Sets the full RX_ADDR_Px address for the specified data pipe.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
- * @param value Pointer to an array containing the 5-byte address to set.
+ * @param value Pointer to an array containing the address to set (address width bytes,
+ *              see device_commands_get_address_width).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_rx_addr_full(device_commands *self, uint32_t pipe, uint8_t *value);
+uint8_t device_commands_set_rx_addr_full(device_commands *self, uint32_t pipe, uint8_t *value);
 
 /**
  * Gets the LSB of the RX_ADDR_Px register for the specified pipe x.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
  * @param value Pointer to a variable where the LSB of the address will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_rx_addr_lsb(device_commands *self, uint32_t pipe, uint8_t *value);
+uint8_t device_commands_get_rx_addr_lsb(device_commands *self, uint32_t pipe, uint8_t *value);
 
 /**
  * Sets the LSB of the RX_ADDR_Px register for the specified pipe x.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
  * @param value The LSB of the address to set.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_rx_addr_lsb(device_commands *self, uint32_t pipe, uint8_t value);
+uint8_t device_commands_set_rx_addr_lsb(device_commands *self, uint32_t pipe, uint8_t value);
 
 /**
- * Gets the full 5-byte TX_ADDR address.
+ * Gets the full TX_ADDR address.
  * @param self Pointer to the device_commands struct to use.
- * @param value Pointer to an array where the 5-byte address will be stored.
+ * @param value Pointer to an array where the address will be stored (address width bytes,
+ *              see device_commands_get_address_width).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_tx_addr_full(device_commands *self, uint8_t *value);
+uint8_t device_commands_get_tx_addr_full(device_commands *self, uint8_t *value);
 
 /**
- * Sets the full 5-byte TX_ADDR address.
+ * Sets the full TX_ADDR address.
  * @param self Pointer to the device_commands struct to use.
- * @param value Pointer to an array containing the 5-byte address to set.
+ * @param value Pointer to an array containing the address to set (address width bytes,
+ *              see device_commands_get_address_width).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_tx_addr_full(device_commands *self, uint8_t *value);
+uint8_t device_commands_set_tx_addr_full(device_commands *self, uint8_t *value);
 
 /**
  * Gets the LSB of the TX_ADDR register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the LSB of the address will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_tx_addr_lsb(device_commands *self, uint8_t *value);
+uint8_t device_commands_get_tx_addr_lsb(device_commands *self, uint8_t *value);
 
 /**
  * Sets the LSB of the TX_ADDR register.
  * @param self Pointer to the device_commands struct to use.
  * @param value The LSB of the address to set.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_tx_addr_lsb(device_commands *self, uint8_t value);
+uint8_t device_commands_set_tx_addr_lsb(device_commands *self, uint8_t value);
 
 /**
  * Gets the value of RX_PW_Px from the RX_PW_Px register for the specified pipe x.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
  * @param value Pointer to a variable where the payload width will be stored (0-32).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_rx_pw(device_commands *self, uint32_t pipe, uint8_t *value);
+uint8_t device_commands_get_rx_pw(device_commands *self, uint32_t pipe, uint8_t *value);
 
 /**
  * Sets the value of RX_PW_Px in the RX_PW_Px register for the specified pipe x.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
  * @param value The payload width to set (0-32).
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_rx_pw(device_commands *self, uint32_t pipe, uint8_t value);
+uint8_t device_commands_set_rx_pw(device_commands *self, uint32_t pipe, uint8_t value);
 
 /**
  * Gets the value of RX_EMPTY from the FIFO_STATUS register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the RX_EMPTY value will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_rx_empty(device_commands *self, bool *value);
+
+/**
+ * Gets all the fields of the FIFO_STATUS register at once, with a single read.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a struct where the fields will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_rx_empty(device_commands *self, bool *value);
+uint8_t device_commands_get_fifo_status(device_commands *self, device_commands_fifo_status *value);
 
 /**
  * Gets the value of DPL_Px from the DYNPD register for the specified pipe x.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
  * @param value Pointer to a variable where the DPL_Px value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_dpl(device_commands *self, uint32_t pipe, bool *value);
+uint8_t device_commands_get_dpl(device_commands *self, uint32_t pipe, bool *value);
 
 /**
  * Sets the value of DPL_Px in the DYNPD register for the specified pipe x.
  * @param self Pointer to the device_commands struct to use.
  * @param pipe The data pipe number (0-5).
  * @param value true to enable, false to disable.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_dpl(device_commands *self, uint32_t pipe, bool value);
+uint8_t device_commands_set_dpl(device_commands *self, uint32_t pipe, bool value);
 
 /**
  * Gets the value of EN_DPL from the FEATURE register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the EN_DPL value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_en_dpl(device_commands *self, bool *value);
+uint8_t device_commands_get_en_dpl(device_commands *self, bool *value);
 
 /**
  * Sets the value of EN_DPL in the FEATURE register.
  * @param self Pointer to the device_commands struct to use.
  * @param value true to enable, false to disable.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_en_dpl(device_commands *self, bool value);
+uint8_t device_commands_set_en_dpl(device_commands *self, bool value);
 
 /**
  * Gets the value of EN_DYN_ACK from the FEATURE register.
  * @param self Pointer to the device_commands struct to use.
  * @param value Pointer to a variable where the EN_DYN_ACK value will be stored.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_get_en_dyn_ack(device_commands *self, bool *value);
+uint8_t device_commands_get_en_dyn_ack(device_commands *self, bool *value);
 
 /**
  * Sets the value of EN_DYN_ACK in the FEATURE register.
  * @param self Pointer to the device_commands struct to use.
  * @param value true to enable, false to disable.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_set_en_dyn_ack(device_commands *self, bool value);
+
+/**
+ * Gets the value of EN_ACK_PAY from the FEATURE register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value Pointer to a variable where the EN_ACK_PAY value will be stored.
+ * @return The value of the STATUS register captured during the command.
+ */
+uint8_t device_commands_get_en_ack_pay(device_commands *self, bool *value);
+
+/**
+ * Sets the value of EN_ACK_PAY in the FEATURE register.
+ * @param self Pointer to the device_commands struct to use.
+ * @param value true to enable, false to disable.
+ * @return The value of the STATUS register captured during the command.
  */
-void device_commands_set_en_dyn_ack(device_commands *self, bool value);
+uint8_t device_commands_set_en_ack_pay(device_commands *self, bool value);
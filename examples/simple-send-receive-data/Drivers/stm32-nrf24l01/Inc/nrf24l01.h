@@ -1,6 +1,7 @@
 #pragma once
 
 #include "device_commands.h"
+#include "spi_bus.h"
 #include "spi_interface.h"
 
 /**
@@ -30,6 +31,110 @@ typedef enum {
     CRC_BYTES_2
 } CrcBytes;
 
+/**
+ * Fastest SPI clock the nRF24l01 device supports (Hz).
+ */
+#define NRF24L01_SPI_MAX_FREQUENCY 10000000
+
+/**
+ * Result of the SPI clock calibration.
+ */
+typedef struct {
+    uint32_t step;              // Clock step that was applied
+    uint32_t frequency;         // Clock frequency that was applied (Hz)
+    uint32_t fastest_step;      // Fastest clock step that passed verification
+    uint32_t fastest_frequency; // Fastest clock frequency that passed verification (Hz)
+    uint32_t margin_steps;      // Number of steps the applied clock is below the fastest passing one
+} nrf24l01_spi_calibration;
+
+/**
+ * Function called while the library sleeps (see nrf24l01_set_idle_hook).
+ * @param context The context given to nrf24l01_set_idle_hook.
+ */
+typedef void (*nrf24l01_idle_hook)(void *context);
+
+/**
+ * Function asked before every beacon whether to stop sending (see nrf24l01_send_beacon).
+ * @param context The context given to nrf24l01_send_beacon.
+ * @return True to stop sending, false to continue.
+ */
+typedef bool (*nrf24l01_beacon_stop)(void *context);
+
+/**
+ * Function receiving the payloads sent back with the acknowledgments (see
+ * nrf24l01_set_ack_payload_callback).
+ * @param payload The received payload. Only valid during the call.
+ * @param payload_length The length of the payload.
+ * @param context The context given to nrf24l01_set_ack_payload_callback.
+ */
+typedef void (*nrf24l01_ack_payload_callback)(uint8_t *payload, uint8_t payload_length, void *context);
+
+/**
+ * Number of RX pipes of the device.
+ */
+#define NRF24L01_PIPE_COUNT 6
+
+/**
+ * Function receiving packets along with the pipe they arrived on.
+ * @param pipe The pipe the packet was received on (0-5).
+ * @param packet The received packet. Only valid during the call.
+ * @param packet_length The length of the packet.
+ * @param context The context given along with the function.
+ */
+typedef void (*nrf24l01_packet_callback)(uint32_t pipe, uint8_t *packet, uint8_t packet_length, void *context);
+
+/**
+ * Ring buffer of received packets, filled by nrf24l01_receive_packets_demux (see
+ * nrf24l01_set_pipe_queue). The storage is supplied by the caller.
+ */
+typedef struct {
+    uint8_t (*packets)[32];   // Storage of the packets
+    uint8_t *packet_lengths;  // Storage of the packet lengths
+    uint32_t capacity;        // Number of packets the storage can hold
+    uint32_t head;            // Index of the oldest packet
+    uint32_t count;           // Number of packets in the queue
+    uint32_t dropped;         // Packets dropped because the queue was full
+} nrf24l01_packet_queue;
+
+/**
+ * Where the packets of a pipe go in nrf24l01_receive_packets_demux.
+ */
+typedef struct {
+    nrf24l01_packet_queue *queue;
+    nrf24l01_packet_callback callback;
+    void *context;
+} nrf24l01_pipe_handler;
+
+/**
+ * Number of RF channels of the device (0-125).
+ */
+#define NRF24L01_CHANNEL_COUNT 126
+
+/**
+ * Time to stay on a channel when scanning, long enough for RPD to be valid (us).
+ */
+#define NRF24L01_SCAN_DWELL_US 170
+
+/**
+ * Number of possible retransmit counts of a packet (ARC_CNT is 4 bits).
+ */
+#define NRF24L01_RETRANSMIT_COUNTS 16
+
+/**
+ * Delivery statistics of the packets sent by nrf24l01_send_packets. The retransmissions of an
+ * acknowledged packet can only be measured if no other packet was waiting behind it in the TX
+ * FIFO, as the device resets its counter when it starts the next packet. The retransmit figures
+ * are then a sample: the last packet of each burst plus the lost packets.
+ */
+typedef struct {
+    uint32_t packets_acked;      // Packets acknowledged by the receiver
+    uint32_t packets_lost;       // Times a packet used all its retransmits without being acknowledged (MAX_RT)
+    uint32_t packets_unmeasured; // Acknowledged packets whose retransmissions couldn't be measured
+    uint32_t retransmits;        // Retransmissions of the measured packets, acknowledged or lost
+    // Measured acknowledged packets by the number of retransmissions they needed
+    uint32_t retransmit_histogram[NRF24L01_RETRANSMIT_COUNTS];
+} nrf24l01_tx_stats;
+
 /**
  * Contains functionality for controlling a nRF24l01 device. Before configuring,
  * it is essential that the user has initialized the corresponding SPI peripheral.
@@ -37,13 +142,18 @@ typedef enum {
 typedef struct nrf24l01 {
     spi_interface spi_handler;
     device_commands commands_handler;
+    nrf24l01_tx_stats tx_stats;
+    nrf24l01_ack_payload_callback ack_payload_callback;
+    void *ack_payload_context;
+    nrf24l01_pipe_handler pipe_handlers[NRF24L01_PIPE_COUNT];
 } nrf24l01;
 
 /**
  * Initializes a nRF24l01 device. Checks if the provided pins correspond to a valid
  * SPI peripheral and initializes them.
  * @param self The nrf24l01 struct to initialize.
- * @param address_prefix 4 bytes of the prefix all pipes will use.
+ * @param address_prefix 4 bytes of the prefix all pipes will use. The addresses are 5 bytes wide
+ *                       until nrf24l01_set_address_width is called.
  * @param spi The SPI handler to use.
  * @param csn_port The CSN GPIO port connected to the device.
  * @param csn_pin The CSN GPIO pin connected to the device.
@@ -55,6 +165,81 @@ bool nrf24l01_init(
         nrf24l01 *self, uint8_t *address_prefix, void *spi, void *csn_port, uint16_t csn_pin,
         void *ce_port, uint16_t ce_pin);
 
+/**
+ * Initializes a nRF24l01 device that shares a SPI peripheral with other devices. Transactions
+ * of the devices registered to the same bus never interleave.
+ * @param self The nrf24l01 struct to initialize.
+ * @param address_prefix 4 bytes of the prefix all pipes will use. The addresses are 5 bytes wide
+ *                       until nrf24l01_set_address_width is called.
+ * @param bus The shared bus the device is connected to. Must be initialized with spi_bus_init.
+ * @param bus_settings The SPI settings to use for this device. Their meaning is defined by the
+ *                     nrf24l01_hal_spi_configure implementation (ex. the clock prescaler).
+ * @param csn_port The CSN GPIO port connected to the device.
+ * @param csn_pin The CSN GPIO pin connected to the device.
+ * @param ce_port The CE GPIO port connected to the device.
+ * @param ce_pin The CE GPIO pin connected to the device.
+ * @return Whether initialization was successful or not.
+ */
+bool nrf24l01_init_shared(
+        nrf24l01 *self, uint8_t *address_prefix, spi_bus *bus, uint32_t bus_settings, void *csn_port,
+        uint16_t csn_pin, void *ce_port, uint16_t ce_pin);
+
+/**
+ * Reads the configuration registers back from the device into the register cache. Must be
+ * called if the device lost power, as its registers went back to their reset values.
+ * @param self The nrf24l01 struct to act upon.
+ */
+void nrf24l01_resync_registers(nrf24l01 *self);
+
+/**
+ * Sets the GPIO connected to the IRQ pin of the device. The send and receive functions then wait
+ * for the pin to go low before reading STATUS, keeping the SPI bus quiet while nothing happens
+ * (see nrf24l01_set_irq_events).
+ * @param self The nrf24l01 struct to act upon.
+ * @param irq_port The IRQ GPIO port connected to the device, or NULL to poll STATUS instead.
+ * @param irq_pin The IRQ GPIO pin connected to the device.
+ */
+void nrf24l01_set_irq_pin(nrf24l01 *self, void *irq_port, uint16_t irq_pin);
+
+/**
+ * Chooses the events that assert the IRQ pin, the others being masked in CONFIG. Ex. an RX node
+ * can wake up on RX_DR only. The send and receive functions only wait on the pin when all the
+ * events they wait for are enabled, and poll STATUS otherwise. All events are enabled by default.
+ * @param self The nrf24l01 struct to act upon.
+ * @param events The events asserting the IRQ pin, any of STATUS_MASK_RX_DR, STATUS_MASK_TX_DS and
+ *               STATUS_MASK_MAX_RT.
+ */
+void nrf24l01_set_irq_events(nrf24l01 *self, uint8_t events);
+
+/**
+ * @param self The nrf24l01 struct to act upon.
+ * @return The events asserting the IRQ pin, see nrf24l01_set_irq_events.
+ */
+uint8_t nrf24l01_get_irq_events(nrf24l01 *self);
+
+/**
+ * Sets a function to run while the library sleeps, ex. during the power up delay. The port calls
+ * it each time it wakes up from its low-power wait, so it should be short. Shared by all devices.
+ * @param hook The function to call, or NULL to only sleep.
+ * @param context Opaque pointer given to the function.
+ */
+void nrf24l01_set_idle_hook(nrf24l01_idle_hook hook, void *context);
+
+/**
+ * Finds the fastest SPI clock that works reliably with the device. Starting from the slowest
+ * clock step of the port (see nrf24l01_hal_spi_set_clock_step), the clock is stepped up as long
+ * as write/readback patterns on the TX_ADDR register verify, without exceeding
+ * NRF24L01_SPI_MAX_FREQUENCY. The clock is then set margin_steps below the fastest passing step.
+ * TX_ADDR is restored and the register cache read again afterwards. On a shared bus, the clock
+ * replaces the bus settings of the device.
+ * @param self The nrf24l01 struct to act upon.
+ * @param margin_steps The number of steps to back off from the fastest passing clock.
+ * @param result Pointer to a struct where the result will be stored. Can be NULL.
+ * @return False if the port has no clock steps, if even the slowest clock failed verification or
+ *         if the clock couldn't be applied, true otherwise.
+ */
+bool nrf24l01_calibrate_spi_clock(nrf24l01 *self, uint32_t margin_steps, nrf24l01_spi_calibration *result);
+
 /**
  * @param self The nrf24l01 struct to act upon.
  * @return True if the device is on, false if not.
@@ -81,7 +266,8 @@ void nrf24l01_power_down(nrf24l01 *self);
 void nrf24l01_set_pipe0_write(nrf24l01 *self, uint8_t address);
 
 /**
- * Configures the specified pipe of the nrf24l01 device for receiving packets.
+ * Configures the specified pipe of the nrf24l01 device for receiving packets. The received packets
+ * are acknowledged (see nrf24l01_set_pipe_read_no_ack).
  * @param self The nrf24l01 struct to act upon.
  * @param pipe The nrf24l01 pipe to act upon. Takes values 0-5. NOTE that if
  *             device is configured as both receiver and transmitter, Pipe 0
@@ -91,6 +277,32 @@ void nrf24l01_set_pipe0_write(nrf24l01 *self, uint8_t address);
  */
 void nrf24l01_set_pipe_read(nrf24l01 *self, uint32_t pipe, uint8_t address);
 
+/**
+ * Configures the specified pipe of the nrf24l01 device for receiving packets without sending
+ * acknowledgments (ex. broadcast telemetry), sparing the receiver the turnaround to TX. The
+ * transmitters must send to it with nrf24l01_send_packets_no_ack, otherwise they retransmit every
+ * packet until MAX_RT. Other pipes can still use acknowledgments.
+ * @param self The nrf24l01 struct to act upon.
+ * @param pipe The nrf24l01 pipe to act upon. Takes values 0-5.
+ * @param address The address to associate the given pipe with.
+ */
+void nrf24l01_set_pipe_read_no_ack(nrf24l01 *self, uint32_t pipe, uint8_t address);
+
+/**
+ * @param self The nrf24l01 struct to act upon.
+ * @return The width of the addresses in bytes (3-5).
+ */
+uint8_t nrf24l01_get_address_width(nrf24l01 *self);
+
+/**
+ * Sets the width of the addresses of all pipes. Shorter addresses take less time on air and less
+ * SPI traffic to set. The last bytes of the addresses (the end of the prefix) are dropped. Both
+ * sides of a link must use the same width.
+ * @param self The nrf24l01 struct to act upon.
+ * @param width The address width in bytes. Valid range is [3, 5].
+ */
+void nrf24l01_set_address_width(nrf24l01 *self, uint8_t width);
+
 /**
  * @param self The nrf24l01 struct to act upon.
  * @return The channel the device is currently set to. Valid range is [0, 125].
@@ -104,6 +316,20 @@ uint8_t nrf24l01_get_channel(nrf24l01 *self);
  */
 void nrf24l01_set_channel(nrf24l01 *self, uint8_t channel);
 
+/**
+ * Measures the occupancy of all channels. Each sweep listens on every channel for
+ * NRF24L01_SCAN_DWELL_US, and adds 1 to histogram[channel] if a signal stronger than -64 dBm was
+ * detected (RPD). The device must be powered up. The channel, the RX/TX mode and CE are restored
+ * afterwards. The RX FIFO is left as is: it keeps the packets received before the scan, and may
+ * get packets sent to the device on the scanned channels (RX_DR is then set). NOTE that
+ * PLOS_CNT is reset by the channel changes.
+ * @param self The nrf24l01 struct to act upon.
+ * @param sweeps The number of sweeps over all channels.
+ * @param histogram Array of NRF24L01_CHANNEL_COUNT counters the detections are added to. They are
+ *                  not reset, so successive scans accumulate.
+ */
+void nrf24l01_scan_channels(nrf24l01 *self, uint32_t sweeps, uint32_t *histogram);
+
 /**
  * @param self The nrf24l01 struct to act upon.
  * @return The current Data rate setting of the device. Can be one of
@@ -194,6 +420,7 @@ void nrf24l01_send_packet(nrf24l01 *self, uint8_t *packet, uint8_t packet_length
 
 /**
  * Sends multiple packets. Used when reliable transmission is required, sacrificing speed.
+ * The packets are added to the delivery statistics (see nrf24l01_get_tx_stats).
  * @param self The nrf24l01 struct to act upon.
  * @param value An array of pointers to the packets to send. The packets can have
  *              different lengths.
@@ -206,6 +433,44 @@ void nrf24l01_send_packet(nrf24l01 *self, uint8_t *packet, uint8_t packet_length
 void nrf24l01_send_packets(
         nrf24l01 *self, uint8_t **value, int count, uint8_t *packet_lengths, bool resend_lost_packets);
 
+/**
+ * Sends a single packet and returns the payload the receiver sent back with the acknowledgment, if
+ * any (see nrf24l01_set_ack_payload).
+ * @param self The nrf24l01 struct to act upon.
+ * @param packet The packet to send.
+ * @param packet_length The length of the packet to send.
+ * @param resend_lost_packet See nrf24l01_send_packet.
+ * @param ack_payload Buffer of 32 bytes where the acknowledgment payload will be stored.
+ * @return The length of the acknowledgment payload, 0 if the packet was acknowledged without
+ *         payload or was lost.
+ */
+uint8_t nrf24l01_send_packet_ack_payload(
+        nrf24l01 *self, uint8_t *packet, uint8_t packet_length, bool resend_lost_packet, uint8_t *ack_payload);
+
+/**
+ * Sets the function receiving the payloads sent back with the acknowledgments of the packets sent
+ * by nrf24l01_send_packets. Without one, they are discarded.
+ * @param self The nrf24l01 struct to act upon.
+ * @param callback The function to call, or NULL to discard the payloads.
+ * @param context Opaque pointer given to the function.
+ */
+void nrf24l01_set_ack_payload_callback(nrf24l01 *self, nrf24l01_ack_payload_callback callback, void *context);
+
+/**
+ * Gets the delivery statistics accumulated by nrf24l01_send_packets since the device was
+ * initialized or the statistics were reset. Use them to tune the retransmit delay and count or
+ * to pick a channel.
+ * @param self The nrf24l01 struct to act upon.
+ * @param stats Pointer to a struct where the statistics will be copied.
+ */
+void nrf24l01_get_tx_stats(nrf24l01 *self, nrf24l01_tx_stats *stats);
+
+/**
+ * Resets the delivery statistics to zero.
+ * @param self The nrf24l01 struct to act upon.
+ */
+void nrf24l01_reset_tx_stats(nrf24l01 *self);
+
 /**
  * Sends a single packet. Used when reliable transmission is not required,
  * favoring speed. Depending on the signal quality, some packets may be lost.
@@ -227,14 +492,48 @@ void nrf24l01_send_packet_no_ack(nrf24l01 *self, uint8_t *packet, uint8_t packet
  */
 void nrf24l01_send_packets_no_ack(nrf24l01 *self, uint8_t **value, int count, uint8_t *packet_lengths);
 
+/**
+ * Sends the same packet periodically without requesting an acknowledgment (ex. beacons, sync
+ * packets). The packet is written to the device once, then every send is triggered by a CE pulse
+ * alone (REUSE_TX_PL), with no SPI traffic in between. The interval must be longer than the time
+ * the packet takes on air plus the 130us TX settling, otherwise sends are skipped.
+ * @param self The nrf24l01 struct to act upon.
+ * @param packet The packet to send.
+ * @param packet_length The length of the packet to send.
+ * @param count The number of times to send the packet, or 0 to send until stopped.
+ * @param interval_us The time between the start of consecutive sends in microseconds.
+ * @param stop Function asked before every send whether to stop. Can be NULL.
+ * @param context Opaque pointer given to the stop function.
+ * @return The number of times the packet was sent.
+ */
+uint32_t nrf24l01_send_beacon(
+        nrf24l01 *self, uint8_t *packet, uint8_t packet_length, uint32_t count, uint32_t interval_us,
+        nrf24l01_beacon_stop stop, void *context);
+
+/**
+ * Loads a payload to send back with the next acknowledgment on the given pipe, giving the
+ * transmitter a return channel without switching modes. Up to 3 payloads can be pending across all
+ * pipes, they are sent in order. The pipe must have been configured with nrf24l01_set_pipe_read.
+ * @param self The nrf24l01 struct to act upon.
+ * @param pipe The pipe to send the payload on. Takes values 0-5.
+ * @param payload The payload to send.
+ * @param payload_length The length of the payload. Valid range is [1, 32].
+ */
+void nrf24l01_set_ack_payload(nrf24l01 *self, uint32_t pipe, uint8_t *payload, uint8_t payload_length);
+
 /**
  * Receives a single packet.
  * @param self  The nrf24l01 struct to act upon.
  * @param packet  The buffer where the received packet will be stored.
- * @param timeout The maximum time to wait for the packet in milliseconds.
+ * @param timeout_us The maximum time to wait for the packet in microseconds.
  * @return If the timeout is reached before the packet is received, the function will return 0.
  *         Otherwise, it will return 1.
  */
+int nrf24l01_receive_packet_us(nrf24l01 *self, uint8_t *packet, uint32_t timeout_us);
+
+/**
+ * Same as nrf24l01_receive_packet_us, with the timeout in milliseconds.
+ */
 int nrf24l01_receive_packet(nrf24l01 *self, uint8_t *packet, uint32_t timeout);
 
 /**
@@ -242,13 +541,18 @@ int nrf24l01_receive_packet(nrf24l01 *self, uint8_t *packet, uint32_t timeout);
  * @param self The nrf24l01 struct to act upon.
  * @param packets An array of pointers to buffers where the received packets will be stored
  * @param count The number of packets to receive.
- * @param timeout The maximum time to wait for packets in milliseconds. If the timeout
- *                is reached before all packets are received, the function will return
- *                the number of packets that were actually received up to that point.
- *                This doesn't apply to the first packet, which will be waited for indefinitely.
+ * @param timeout_us The maximum time to wait for packets in microseconds. If the timeout
+ *                   is reached before all packets are received, the function will return
+ *                   the number of packets that were actually received up to that point.
+ *                   This doesn't apply to the first packet, which will be waited for indefinitely.
  * @return The number of packets actually received. If no packets were lost, this will
  *         be equal to 'count'.
  */
+int nrf24l01_receive_packets_us(nrf24l01 *self, uint8_t **packets, int count, uint32_t timeout_us);
+
+/**
+ * Same as nrf24l01_receive_packets_us, with the timeout in milliseconds.
+ */
 int nrf24l01_receive_packets(nrf24l01 *self, uint8_t **packets, int count, uint32_t timeout);
 
 /**
@@ -260,3 +564,73 @@ int nrf24l01_receive_packets(nrf24l01 *self, uint8_t **packets, int count, uint3
  *                       a pointer to the received packet and the length of the packet.
  */
 void nrf24l01_receive_packets_inf(nrf24l01 *self, void (*value_callback)(uint8_t *packet, uint8_t packet_length));
+
+/**
+ * Receives a specified number of packets along with the pipe each one arrived on. Same as
+ * nrf24l01_receive_packets_us otherwise, the pipe numbers come with the packets at no extra cost.
+ * @param self The nrf24l01 struct to act upon.
+ * @param packets An array of pointers to buffers where the received packets will be stored.
+ * @param pipes An array where the pipe of each received packet will be stored.
+ * @param count The number of packets to receive.
+ * @param timeout_us See nrf24l01_receive_packets_us.
+ * @return The number of packets actually received.
+ */
+int nrf24l01_receive_packets_pipes(nrf24l01 *self, uint8_t **packets, uint8_t *pipes, int count, uint32_t timeout_us);
+
+/**
+ * Continuously receives packets, calling the provided callback function with each packet and
+ * the pipe it arrived on.
+ * @param self The nrf24l01 struct to act upon.
+ * @param callback The function called for each received packet.
+ * @param context Opaque pointer given to the function.
+ */
+void nrf24l01_receive_packets_inf_pipes(nrf24l01 *self, nrf24l01_packet_callback callback, void *context);
+
+/**
+ * Initializes an empty packet queue backed by the given storage.
+ * @param self The nrf24l01_packet_queue struct to initialize.
+ * @param packets Storage for capacity packets.
+ * @param packet_lengths Storage for capacity packet lengths.
+ * @param capacity The number of packets the queue can hold.
+ */
+void nrf24l01_packet_queue_init(
+        nrf24l01_packet_queue *self, uint8_t (*packets)[32], uint8_t *packet_lengths, uint32_t capacity);
+
+/**
+ * Takes the oldest packet out of the queue.
+ * @param self The nrf24l01_packet_queue struct to act upon.
+ * @param packet Buffer of 32 bytes where the packet will be copied.
+ * @param packet_length Pointer to a variable where the length of the packet will be stored.
+ * @return False if the queue is empty, true otherwise.
+ */
+bool nrf24l01_packet_queue_pop(nrf24l01_packet_queue *self, uint8_t *packet, uint8_t *packet_length);
+
+/**
+ * Sets the queue the packets of the given pipe are stored in by nrf24l01_receive_packets_demux.
+ * The queue is used over the callback of the pipe, if both are set.
+ * @param self The nrf24l01 struct to act upon.
+ * @param pipe The pipe to act upon. Takes values 0-5.
+ * @param queue The queue to fill, must be initialized with nrf24l01_packet_queue_init. NULL to
+ *              stop queueing.
+ */
+void nrf24l01_set_pipe_queue(nrf24l01 *self, uint32_t pipe, nrf24l01_packet_queue *queue);
+
+/**
+ * Sets the function the packets of the given pipe are given to by nrf24l01_receive_packets_demux.
+ * @param self The nrf24l01 struct to act upon.
+ * @param pipe The pipe to act upon. Takes values 0-5.
+ * @param callback The function to call, or NULL to stop calling it.
+ * @param context Opaque pointer given to the function.
+ */
+void nrf24l01_set_pipe_callback(nrf24l01 *self, uint32_t pipe, nrf24l01_packet_callback callback, void *context);
+
+/**
+ * Receives packets and delivers each one to the queue or callback of the pipe it arrived on (see
+ * nrf24l01_set_pipe_queue and nrf24l01_set_pipe_callback). Packets of pipes with neither are
+ * dropped. Lets a single receiver serve several transmitters without sender IDs in the payloads.
+ * @param self The nrf24l01 struct to act upon.
+ * @param count The number of packets to receive, or 0 to receive indefinitely.
+ * @param timeout_us See nrf24l01_receive_packets_us. Ignored if count is 0.
+ * @return The number of packets received, including the dropped ones.
+ */
+int nrf24l01_receive_packets_demux(nrf24l01 *self, int count, uint32_t timeout_us);
@@ -0,0 +1,121 @@
+#pragma once
+
+// Register-level port for the STM32F1. GPIO and SPI are driven directly through their registers,
+// skipping the state checks of the HAL functions that dominate short transactions. The functions
+// are either compiled by nrf24l01_hal_registers.c (NRF24L01_PORT_REGISTERS) or inlined into the
+// library along with the pins below (NRF24L01_HAL_INLINE). The timing and critical section
+// functions are shared with the HAL based port (nrf24l01_hal_timing.h).
+
+#include "nrf24l01_hal.h"
+
+#include "stm32f1xx_hal.h"
+#include "nrf24l01_hal_timing.h"
+
+#ifdef NRF24L01_HAL_INLINE
+// Bind the SPI peripheral and pins of the device at compile time
+extern SPI_HandleTypeDef hspi1;
+#define NRF24L01_HAL_SPI (&hspi1)
+#define NRF24L01_HAL_CSN_PORT GPIOB
+#define NRF24L01_HAL_CSN_PIN GPIO_PIN_0
+#define NRF24L01_HAL_CE_PORT GPIOB
+#define NRF24L01_HAL_CE_PIN GPIO_PIN_1
+#endif
+
+NRF24L01_HAL_FUNCTION void nrf24l01_hal_write_pin(void *port, uint16_t pin, bool value) {
+    if (port == NULL) {
+        return;
+    }
+
+    // The upper half of BSRR resets the pin, the lower half sets it
+    ((GPIO_TypeDef *) port)->BSRR = value ? pin : (uint32_t) pin << 16;
+}
+
+NRF24L01_HAL_FUNCTION bool nrf24l01_hal_wait_pin(void *port, uint16_t pin, bool value, uint32_t timeout_us) {
+    uint32_t start = nrf24l01_hal_get_us_ticks();
+    while (((((GPIO_TypeDef *) port)->IDR & pin) != 0) != value) {
+        nrf24l01_hal_idle();
+        if (timeout_us != UINT32_MAX && nrf24l01_hal_elapsed_us(start) >= timeout_us) {
+            return false;
+        }
+    }
+    return true;
+}
+
+NRF24L01_HAL_FUNCTION uint8_t nrf24l01_hal_spi_transfer(
+        void *spi, const nrf24l01_hal_spi_segment *segments, uint32_t count, uint32_t timeout) {
+    // The flags are polled without a timeout, the peripheral always completes a byte
+    (void) timeout;
+
+    SPI_TypeDef *instance = ((SPI_HandleTypeDef *) spi)->Instance;
+    volatile uint8_t *data_register = (volatile uint8_t *) &instance->DR;
+
+    // Every byte is transmitted and received (full-duplex). Waiting for RXNE after each byte also
+    // guarantees that the bus is idle when returning, so CSN can be released right away.
+    for (uint32_t i = 0; i < count; i++) {
+        if (!(instance->CR1 & SPI_CR1_SPE)) {
+            instance->CR1 |= SPI_CR1_SPE;
+        }
+
+        const uint8_t *tx_data = segments[i].tx_data;
+        uint8_t *rx_data = segments[i].rx_data;
+        for (uint16_t j = 0; j < segments[i].size; j++) {
+            while (!(instance->SR & SPI_SR_TXE)) {
+            }
+            *data_register = tx_data != NULL ? tx_data[j] : 0xFF;
+
+            while (!(instance->SR & SPI_SR_RXNE)) {
+            }
+            uint8_t value = *data_register;
+            if (rx_data != NULL) {
+                rx_data[j] = value;
+            }
+        }
+
+        // With the NSS pin set as hardware output (SSOE), CSN is only high while the peripheral
+        // is disabled, so end the frame by disabling it
+        if (segments[i].frame_end) {
+            while (instance->SR & SPI_SR_BSY) {
+            }
+            instance->CR1 &= ~SPI_CR1_SPE;
+        }
+    }
+
+    return HAL_OK;
+}
+
+NRF24L01_HAL_FUNCTION bool nrf24l01_hal_spi_transfer_async(void *spi, const nrf24l01_hal_spi_segment *segment, void *context) {
+    // No DMA support, the library falls back to nrf24l01_hal_spi_transfer
+    (void) spi;
+    (void) segment;
+    (void) context;
+    return false;
+}
+
+NRF24L01_HAL_FUNCTION void nrf24l01_hal_spi_configure(void *spi, uint32_t settings) {
+    // The settings are the SPI_BAUDRATEPRESCALER_x value to use for the device
+    SPI_HandleTypeDef *hspi = spi;
+    if (hspi->Init.BaudRatePrescaler == settings) {
+        return;
+    }
+
+    // nrf24l01_hal_spi_transfer re-enables the peripheral
+    hspi->Init.BaudRatePrescaler = settings;
+    hspi->Instance->CR1 &= ~SPI_CR1_SPE;
+    MODIFY_REG(hspi->Instance->CR1, SPI_CR1_BR, settings);
+}
+
+NRF24L01_HAL_FUNCTION bool nrf24l01_hal_spi_set_clock_step(void *spi, uint32_t step, uint32_t *frequency, uint32_t *settings) {
+    // Step 0 is the largest prescaler (256), each step halves it down to 2
+    if (step > 7) {
+        return false;
+    }
+
+    SPI_HandleTypeDef *hspi = spi;
+    *settings = (7 - step) << SPI_CR1_BR_Pos;
+    nrf24l01_hal_spi_configure(spi, *settings);
+
+    // SPI1 is clocked by APB2, SPI2 by APB1
+    uint32_t pclk = hspi->Instance == SPI1 ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+    *frequency = pclk >> (8 - step);
+    return true;
+}
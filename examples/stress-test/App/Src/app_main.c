@@ -5,10 +5,14 @@
 #include <stdlib.h>
 
 #include "nrf24l01.h"
+#include "spi_stats.h"
 
 #define CONFIGURE_TX
 // #define CONFIGURE_RX
 
+// Measure the per-transaction overhead of the selected port before running
+// #define RUN_BENCHMARK
+
 #define RUNS 10
 
 int count = 0;
@@ -98,12 +102,82 @@ void tx() {
 
     uint32_t elapsed_time_ms = HAL_GetTick() - start_time;
     printf("Execution time: %lu ms, count = %d\r\n", elapsed_time_ms, count);
+
+    // Retransmissions per packet, to tune the retransmit delay/count and the channel
+    nrf24l01_tx_stats stats;
+    nrf24l01_get_tx_stats(&device, &stats);
+    printf("Acked: %lu (unmeasured: %lu), lost: %lu, retransmits: %lu\r\n", stats.packets_acked,
+           stats.packets_unmeasured, stats.packets_lost, stats.retransmits);
+    for (int i = 0; i < NRF24L01_RETRANSMIT_COUNTS; i++) {
+        if (stats.retransmit_histogram[i] > 0) {
+            printf("  %2d retransmits: %lu packets\r\n", i, stats.retransmit_histogram[i]);
+        }
+    }
+}
+
+#if defined(NRF24L01_HAL_INLINE)
+#define PORT_NAME "inlined register-level"
+#elif defined(NRF24L01_PORT_REGISTERS)
+#define PORT_NAME "register-level"
+#else
+#define PORT_NAME "HAL"
+#endif
+
+#define BENCHMARK_ITERATIONS 1000
+
+void benchmark() {
+    printf("Benchmarking the %s port\r\n", PORT_NAME);
+
+    // Initialize the device
+    nrf24l01 device;
+    uint8_t address_prefix[4] = {0xB3, 0xB4, 0xB5, 0xB6};
+    if (!nrf24l01_init(&device, address_prefix, &hspi1, GPIOB, GPIO_PIN_0, GPIOB, GPIO_PIN_1)) {
+        printf("Could not initialize device\r\n");
+        return;
+    }
+
+    // Only the benchmarked transactions end up in the statistics (NRF24L01_INSTRUMENTATION)
+    spi_stats_reset();
+
+    // Count CPU cycles with the DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    // 1-byte register access
+    uint32_t start = DWT->CYCCNT;
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        nrf24l01_get_channel(&device);
+    }
+    uint32_t register_cycles = (DWT->CYCCNT - start) / BENCHMARK_ITERATIONS;
+
+    // 32-byte payload write
+    uint8_t payload[32] = {0};
+    start = DWT->CYCCNT;
+    for (int i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        device_commands_w_tx_payload(&device.commands_handler, payload, 32);
+        device_commands_flush_tx(&device.commands_handler);
+    }
+    uint32_t payload_cycles = (DWT->CYCCNT - start) / BENCHMARK_ITERATIONS;
+
+    // The same line is printed by the build of each port, along with the clocks the cycles depend
+    // on, so that the results can be put side by side
+    uint32_t cycles_per_us = SystemCoreClock / 1000000;
+    uint32_t spi_frequency = HAL_RCC_GetPCLK2Freq() >> (((hspi1.Init.BaudRatePrescaler & SPI_CR1_BR) >> SPI_CR1_BR_Pos) + 1);
+    printf("port                    core (Hz)  SPI (Hz)  register read (cycles/ns)  payload write + flush (cycles/ns)\r\n");
+    printf("%-22s %10lu %9lu %12lu %12lu %16lu %16lu\r\n", PORT_NAME, SystemCoreClock, spi_frequency,
+           register_cycles, register_cycles * 1000 / cycles_per_us, payload_cycles,
+           payload_cycles * 1000 / cycles_per_us);
+    spi_stats_dump();
 }
 
 void app_main() {
     printf("\x1B[2J\r\n");
     printf("Starting...\r\n");
 
+#ifdef RUN_BENCHMARK
+    benchmark();
+#endif
+
 #if defined(CONFIGURE_TX) && defined(CONFIGURE_RX)
     printf("Select only one of CONFIGURE_TX and CONFIGURE_RX\r\n");
 #elif defined(CONFIGURE_TX)
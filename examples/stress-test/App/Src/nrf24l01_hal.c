@@ -1,45 +1,145 @@
 #include "nrf24l01_hal.h"
 
+// The register-level port (nrf24l01_hal_port.h) is used instead when NRF24L01_PORT_REGISTERS or
+// NRF24L01_HAL_INLINE is defined
+#if !defined(NRF24L01_PORT_REGISTERS) && !defined(NRF24L01_HAL_INLINE)
+
 #include "stm32f1xx_hal.h"
+#include "nrf24l01_hal_timing.h"
 
 void nrf24l01_hal_write_pin(void *port, uint16_t pin, bool value) {
+    // No CSN pin, it is driven by the SPI peripheral (see nrf24l01_hal_spi_transfer)
+    if (port == NULL) {
+        return;
+    }
+
     GPIO_PinState state = value ? GPIO_PIN_SET : GPIO_PIN_RESET;
     HAL_GPIO_WritePin(port, pin, state);
 }
 
-uint8_t nrf24l01_hal_spi_transmit(void *spi, const uint8_t *data, uint16_t size, uint32_t timeout) {
-    return HAL_SPI_Transmit(spi, data, size, timeout);
+bool nrf24l01_hal_wait_pin(void *port, uint16_t pin, bool value, uint32_t timeout_us) {
+    GPIO_PinState state = value ? GPIO_PIN_SET : GPIO_PIN_RESET;
+    uint32_t start = nrf24l01_hal_get_us_ticks();
+    while (HAL_GPIO_ReadPin(port, pin) != state) {
+        nrf24l01_hal_idle();
+        if (timeout_us != UINT32_MAX && nrf24l01_hal_elapsed_us(start) >= timeout_us) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t nrf24l01_hal_spi_transfer(
+        void *spi, const nrf24l01_hal_spi_segment *segments, uint32_t count, uint32_t timeout) {
+    for (uint32_t i = 0; i < count; i++) {
+        const nrf24l01_hal_spi_segment *segment = &segments[i];
+        // The HAL takes non-const buffers but never writes to the transmitted ones
+        uint8_t *tx_data = (uint8_t *) segment->tx_data;
+
+        HAL_StatusTypeDef status;
+        if (tx_data != NULL && segment->rx_data != NULL) {
+            status = HAL_SPI_TransmitReceive(spi, tx_data, segment->rx_data, segment->size, timeout);
+        } else if (tx_data != NULL) {
+            status = HAL_SPI_Transmit(spi, tx_data, segment->size, timeout);
+        } else {
+            status = HAL_SPI_Receive(spi, segment->rx_data, segment->size, timeout);
+        }
+
+        if (status != HAL_OK) {
+            return status;
+        }
+
+        // With the NSS pin set as hardware output (SSOE), CSN is only high while the peripheral
+        // is disabled. The HAL functions enable it again for the next segment.
+        if (segment->frame_end) {
+            __HAL_SPI_DISABLE((SPI_HandleTypeDef *) spi);
+        }
+    }
+
+    return HAL_OK;
 }
 
-uint8_t nrf24l01_hal_spi_receive(void *spi, uint8_t *data, uint16_t size, uint32_t timeout) {
-    return HAL_SPI_Receive(spi, data, size, timeout);
+// Contexts of the asynchronous transfers in progress on SPI1 and SPI2
+static void *transfer_contexts[2];
+
+static void **get_transfer_context(SPI_HandleTypeDef *hspi) {
+    return &transfer_contexts[hspi->Instance == SPI1 ? 0 : 1];
 }
 
-static void sleep_ticks(uint32_t ticks)
-{
-    uint32_t start = SysTick->VAL;
-    uint32_t reload = SysTick->LOAD + 1;
-    uint32_t elapsed = 0;
+bool nrf24l01_hal_spi_transfer_async(void *spi, const nrf24l01_hal_spi_segment *segment, void *context) {
+    SPI_HandleTypeDef *hspi = spi;
 
-    while (elapsed < ticks)
-    {
-        uint32_t now = SysTick->VAL;
-        if (start >= now)
-            elapsed += start - now;
-        else
-            elapsed += start + (reload - now);
-        start = now;
+    // The DMA channels must be linked to the SPI handle (ex. by adding SPI1_RX and SPI1_TX DMA
+    // requests in CubeMX). Otherwise, let the library fall back to a blocking transfer.
+    if (hspi->hdmatx == NULL || hspi->hdmarx == NULL) {
+        return false;
+    }
+
+    *get_transfer_context(hspi) = context;
+
+    // The HAL takes non-const buffers but never writes to the transmitted ones
+    uint8_t *tx_data = (uint8_t *) segment->tx_data;
+
+    HAL_StatusTypeDef status;
+    if (tx_data != NULL && segment->rx_data != NULL) {
+        status = HAL_SPI_TransmitReceive_DMA(hspi, tx_data, segment->rx_data, segment->size);
+    } else if (tx_data != NULL) {
+        status = HAL_SPI_Transmit_DMA(hspi, tx_data, segment->size);
+    } else {
+        status = HAL_SPI_Receive_DMA(hspi, segment->rx_data, segment->size);
+    }
+
+    return status == HAL_OK;
+}
+
+static void transfer_complete(SPI_HandleTypeDef *hspi) {
+    void **context = get_transfer_context(hspi);
+    if (*context != NULL) {
+        void *completed_context = *context;
+        *context = NULL;
+        nrf24l01_hal_spi_transfer_complete(completed_context);
     }
 }
 
-void nrf24l01_hal_sleep_ms(uint32_t ms) {
-    sleep_ticks(ms * (SystemCoreClock / 1000));
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
+    transfer_complete(hspi);
 }
 
-void nrf24l01_hal_sleep_us(uint32_t us) {
-    sleep_ticks(us * (SystemCoreClock / 1000000));
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi) {
+    transfer_complete(hspi);
 }
 
-uint32_t nrf24l01_hal_get_ms_ticks() {
-    return HAL_GetTick();
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi) {
+    transfer_complete(hspi);
 }
+
+void nrf24l01_hal_spi_configure(void *spi, uint32_t settings) {
+    // The settings are the SPI_BAUDRATEPRESCALER_x value to use for the device
+    SPI_HandleTypeDef *hspi = spi;
+    if (hspi->Init.BaudRatePrescaler == settings) {
+        return;
+    }
+
+    // The HAL functions re-enable the peripheral on the next transfer
+    hspi->Init.BaudRatePrescaler = settings;
+    __HAL_SPI_DISABLE(hspi);
+    MODIFY_REG(hspi->Instance->CR1, SPI_CR1_BR, settings);
+}
+
+bool nrf24l01_hal_spi_set_clock_step(void *spi, uint32_t step, uint32_t *frequency, uint32_t *settings) {
+    // Step 0 is the largest prescaler (256), each step halves it down to 2
+    if (step > 7) {
+        return false;
+    }
+
+    SPI_HandleTypeDef *hspi = spi;
+    *settings = (7 - step) << SPI_CR1_BR_Pos;
+    nrf24l01_hal_spi_configure(spi, *settings);
+
+    // SPI1 is clocked by APB2, SPI2 by APB1
+    uint32_t pclk = hspi->Instance == SPI1 ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+    *frequency = pclk >> (8 - step);
+    return true;
+}
+
+#endif
@@ -0,0 +1,8 @@
+// Compiles the register-level port of nrf24l01_hal_port.h when NRF24L01_PORT_REGISTERS is defined,
+// in which case it replaces the HAL based port (nrf24l01_hal.c). With NRF24L01_HAL_INLINE the port
+// is inlined into the library instead and nothing is compiled here.
+#if defined(NRF24L01_PORT_REGISTERS) && !defined(NRF24L01_HAL_INLINE)
+
+#include "nrf24l01_hal_port.h"
+
+#endif
@@ -3,47 +3,167 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// The port functions are normally linked from the port's source file. When NRF24L01_HAL_INLINE
+// is defined, the port instead defines them as static inline in nrf24l01_hal_port.h so they are
+// bound at compile time and inlined into the library. The port header can also bind the SPI
+// peripheral and the pins (see spi_interface.c), which limits the library to a single device.
+#ifdef NRF24L01_HAL_INLINE
+#define NRF24L01_HAL_FUNCTION static inline
+#else
+#define NRF24L01_HAL_FUNCTION
+#endif
+
+// Checks a condition the library can't recover from, ex. a bus that is never released. Defaults
+// to assert; define NRF24L01_ASSERT in the compiler flags to report it otherwise (ex. a breakpoint
+// or a log before resetting).
+#ifndef NRF24L01_ASSERT
+#include <assert.h>
+#define NRF24L01_ASSERT(condition) assert(condition)
+#endif
+
+/**
+ * A part of a SPI transaction. The segments of a transaction are clocked back to back
+ * while CSN is held low, so a command byte and a payload living in different memory
+ * locations can be transferred without copying them into a common buffer.
+ */
+typedef struct {
+    const uint8_t *tx_data; // Bytes to transmit. NULL to transmit dummy bytes.
+    uint8_t *rx_data;       // Buffer for the received bytes. NULL to discard them.
+    uint16_t size;          // Number of bytes in the segment.
+    bool frame_end;         // Last segment of a command: CSN must be high after it. Set on every command,
+                            // only acted upon by ports whose SPI peripheral drives CSN (csn_port NULL).
+} nrf24l01_hal_spi_segment;
+
+/**
+ * Implemented by the library. Must be called by the port when a transfer started with
+ * nrf24l01_hal_spi_transfer_async completes. Safe to call from interrupt context.
+ * @param context The context that was given to nrf24l01_hal_spi_transfer_async.
+ */
+void nrf24l01_hal_spi_transfer_complete(void *context);
+
+/**
+ * Implemented by the library. Should be called by the port from nrf24l01_hal_sleep_us and
+ * nrf24l01_hal_wait_pin each time it wakes up (or polls) while waiting, to run the idle hook set
+ * with nrf24l01_set_idle_hook.
+ */
+void nrf24l01_hal_idle();
+
 /**
  * Writes 0 or 1 to the specified pin at the specified port.
  * @param port The port GPIOx of the pin (NULL if not needed).
  * @param pin The pin number.
  * @param value The value to write (0 or 1)
  */
-void nrf24l01_hal_write_pin(void *port, uint16_t pin, bool value);
+NRF24L01_HAL_FUNCTION void nrf24l01_hal_write_pin(void *port, uint16_t pin, bool value);
+
+/**
+ * Waits until the specified pin has the specified value, ex. by sleeping until an edge interrupt.
+ * Only needed if an IRQ pin is set.
+ * @param port The port GPIOx of the pin.
+ * @param pin The pin number.
+ * @param value The value to wait for (0 or 1).
+ * @param timeout_us The maximum number of microseconds to wait (UINT32_MAX to wait indefinitely).
+ * @return True if the pin has the value, false if the timeout expired.
+ */
+NRF24L01_HAL_FUNCTION bool nrf24l01_hal_wait_pin(void *port, uint16_t pin, bool value, uint32_t timeout_us);
+
+/**
+ * Transfers (full-duplex) the given segments one after the other through the specified
+ * SPI interface. CSN is handled by the caller when it has a pin. Otherwise, the port must raise
+ * CSN after each frame_end segment (and lower it again before the next one).
+ * @param spi Pointer to the SPI interface to use. Ex. &hspi1.
+ * @param segments The array of segments to transfer.
+ * @param count The number of segments.
+ * @param timeout The maximum time to wait for the transfer, in a port-defined unit (milliseconds
+ *        for the STM32 HAL). The library always passes UINT32_MAX, which means no timeout.
+ * @return The status of the transfer.
+ */
+NRF24L01_HAL_FUNCTION uint8_t nrf24l01_hal_spi_transfer(
+        void *spi, const nrf24l01_hal_spi_segment *segments, uint32_t count, uint32_t timeout);
+
+/**
+ * Starts a non-blocking transfer (ex. using DMA) of a single segment through the specified
+ * SPI interface and returns immediately. When the transfer completes, the port must call
+ * nrf24l01_hal_spi_transfer_complete with the given context, typically from the transfer
+ * complete interrupt. CSN is handled by the library.
+ * @param spi Pointer to the SPI interface to use. Ex. &hspi1.
+ * @param segment The segment to transfer. Stays valid until the transfer completes.
+ * @param context Opaque pointer to pass to nrf24l01_hal_spi_transfer_complete.
+ * @return True if the transfer was started. False if the port cannot transfer
+ *         asynchronously, in which case the library falls back to nrf24l01_hal_spi_transfer.
+ */
+NRF24L01_HAL_FUNCTION bool nrf24l01_hal_spi_transfer_async(void *spi, const nrf24l01_hal_spi_segment *segment, void *context);
 
 /**
- * Transmits an array of bytes through the specified SPI interface.
+ * Applies device specific settings (ex. the clock prescaler) to the specified SPI interface.
+ * Only used when several devices share a SPI bus, each time a different device takes it over.
  * @param spi Pointer to the SPI interface to use. Ex. &hspi1.
- * @param data The array of bytes to transmit.
- * @param size The number of bytes to transmit.
- * @param timeout The amount of milliseconds to timeout after.
- * @return The status of the transmission.
+ * @param settings The settings given to spi_interface_init_shared for the device.
  */
-uint8_t nrf24l01_hal_spi_transmit(void *spi, const uint8_t *data, uint16_t size, uint32_t timeout);
+NRF24L01_HAL_FUNCTION void nrf24l01_hal_spi_configure(void *spi, uint32_t settings);
 
 /**
- * Receives an array of bytes through the specified SPI interface.
+ * Sets the clock of the specified SPI interface to one of the steps it supports, ordered from
+ * the slowest (step 0) to the fastest. Used to calibrate the clock for the wiring at hand.
  * @param spi Pointer to the SPI interface to use. Ex. &hspi1.
- * @param data A array buffer of bytes to receive.
- * @param size The number of bytes to receive.
- * @param timeout The amount of milliseconds to timeout after.
- * @return The status of the reception.
+ * @param step The clock step to apply.
+ * @param frequency Pointer to a variable where the resulting clock frequency (Hz) will be stored.
+ * @param settings Pointer to a variable where the settings applying the same clock through
+ *        nrf24l01_hal_spi_configure will be stored.
+ * @return False if the step is not supported (past the fastest one), true otherwise.
  */
-uint8_t nrf24l01_hal_spi_receive(void *spi, uint8_t *data, uint16_t size, uint32_t timeout);
+NRF24L01_HAL_FUNCTION bool nrf24l01_hal_spi_set_clock_step(void *spi, uint32_t step, uint32_t *frequency, uint32_t *settings);
 
 /**
- * Sleeps for the specified number of milliseconds.
- * @param ms The number of milliseconds to sleep.
+ * Disables interrupts so that the code up to nrf24l01_hal_exit_critical runs atomically.
+ * @return The previous interrupt state, to give to nrf24l01_hal_exit_critical.
  */
-void nrf24l01_hal_sleep_ms(uint32_t ms);
+NRF24L01_HAL_FUNCTION uint32_t nrf24l01_hal_enter_critical();
 
 /**
- * Sleeps for the specified number of microseconds.
+ * Restores the interrupt state saved by nrf24l01_hal_enter_critical.
+ * @param state The value returned by nrf24l01_hal_enter_critical.
+ */
+NRF24L01_HAL_FUNCTION void nrf24l01_hal_exit_critical(uint32_t state);
+
+/**
+ * Sleeps for the specified number of microseconds, preferably in a low-power mode (ex. WFI until a
+ * timer compare) rather than busy-waiting. Used for all the delays of the library.
  * @param us The number of microseconds to sleep.
  */
-void nrf24l01_hal_sleep_us(uint32_t us);
+NRF24L01_HAL_FUNCTION void nrf24l01_hal_sleep_us(uint32_t us);
+
+/**
+ * @return A monotonic microsecond clock. Expected to wrap around at 2^32 (about 71 minutes).
+ */
+NRF24L01_HAL_FUNCTION uint32_t nrf24l01_hal_get_us_ticks();
+
+/**
+ * @param since A value previously returned by nrf24l01_hal_get_us_ticks.
+ * @return The number of microseconds elapsed since then, correct across a wraparound of the clock.
+ */
+static inline uint32_t nrf24l01_hal_elapsed_us(uint32_t since) { return nrf24l01_hal_get_us_ticks() - since; }
 
 /**
- * @return The number of milliseconds since the system started.
+ * Busy-waits for at least the specified number of microseconds. Unlike nrf24l01_hal_sleep_us, it
+ * doesn't run the idle hook, so it is used for the short delays that must not be stretched.
+ * @param us The number of microseconds to wait.
  */
-uint32_t nrf24l01_hal_get_ms_ticks();
+static inline void nrf24l01_hal_delay_us(uint32_t us) {
+    // The first tick may be partial, so wait for one more
+    uint32_t start = nrf24l01_hal_get_us_ticks();
+    while (nrf24l01_hal_elapsed_us(start) <= us) {
+    }
+}
+
+#ifdef NRF24L01_INSTRUMENTATION
+/**
+ * Only needed when NRF24L01_INSTRUMENTATION is defined, to measure the SPI transactions.
+ * @return A free-running cycle counter (ex. DWT->CYCCNT). Expected to wrap around at 2^32.
+ */
+NRF24L01_HAL_FUNCTION uint32_t nrf24l01_hal_get_cycles();
+#endif
+
+#ifdef NRF24L01_HAL_INLINE
+#include "nrf24l01_hal_port.h"
+#endif
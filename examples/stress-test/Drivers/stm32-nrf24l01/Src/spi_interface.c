@@ -1,8 +1,42 @@
 #include "spi_interface.h"
 
-#include <string.h>
+#include <stddef.h>
 
 #include "nrf24l01_hal.h"
+#include "spi_bus.h"
+#include "spi_stats.h"
+
+// A port bound at compile time can provide the SPI peripheral and pins as constants. self is still
+// evaluated (for nothing) so that the functions only using it through these macros don't warn.
+#ifdef NRF24L01_HAL_CSN_PIN
+#define SPI_INTERFACE_SPI(self) ((void) (self), NRF24L01_HAL_SPI)
+#define SPI_INTERFACE_CSN(self) NRF24L01_HAL_CSN_PORT, NRF24L01_HAL_CSN_PIN
+#define SPI_INTERFACE_CE(self) NRF24L01_HAL_CE_PORT, NRF24L01_HAL_CE_PIN
+#define SPI_INTERFACE_HARDWARE_CSN(self) false
+#else
+#define SPI_INTERFACE_SPI(self) (self)->spi
+#define SPI_INTERFACE_CSN(self) (self)->csn_port, (self)->csn_pin
+#define SPI_INTERFACE_CE(self) (self)->ce_port, (self)->ce_pin
+#define SPI_INTERFACE_HARDWARE_CSN(self) ((self)->csn_port == NULL)
+#endif
+
+// Maximum number of segments of a queue transferred in one go when CSN is driven by the SPI
+// peripheral (3 per command)
+#define SPI_INTERFACE_BATCH_SEGMENTS 24
+
+// The bus and the asynchronous commands are only held for the duration of a transaction, so
+// waiting longer for them means they are never released (ex. waited on from an interrupt that
+// preempted their owner)
+#define SPI_INTERFACE_WAIT_TIMEOUT_US 100000
+
+// The IRQ pin can be bound separately, as it is optional
+#ifdef NRF24L01_HAL_IRQ_PIN
+#define SPI_INTERFACE_HAS_IRQ(self) true
+#define SPI_INTERFACE_IRQ(self) NRF24L01_HAL_IRQ_PORT, NRF24L01_HAL_IRQ_PIN
+#else
+#define SPI_INTERFACE_HAS_IRQ(self) ((self)->irq_port != NULL)
+#define SPI_INTERFACE_IRQ(self) (self)->irq_port, (self)->irq_pin
+#endif
 
 void spi_interface_init(
         spi_interface *self, void *spi, void *csn_port, uint16_t csn_pin, void *ce_port,
@@ -12,44 +46,281 @@ void spi_interface_init(
     self->csn_pin = csn_pin;
     self->ce_port = ce_port;
     self->ce_pin = ce_pin;
+    self->ce_state = false;
+    self->irq_port = NULL;
+    self->irq_pin = 0;
+    self->bus = NULL;
+    self->bus_settings = 0;
+    self->busy = false;
+    self->async_callback = NULL;
+    self->async_context = NULL;
 
     // Set CSN to 1 and CE to 0
-    nrf24l01_hal_write_pin(self->csn_port, self->csn_pin, 1);
-    nrf24l01_hal_write_pin(self->ce_port, self->ce_pin, 0);
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CSN(self), 1);
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CE(self), 0);
+}
+
+bool spi_interface_init_shared(
+        spi_interface *self, spi_bus *bus, uint32_t bus_settings, void *csn_port, uint16_t csn_pin,
+        void *ce_port, uint16_t ce_pin) {
+    spi_interface_init(self, bus->spi, csn_port, csn_pin, ce_port, ce_pin);
+    self->bus = bus;
+    self->bus_settings = bus_settings;
+    return spi_bus_register(bus, self);
+}
+
+void spi_interface_set_irq_pin(spi_interface *self, void *irq_port, uint16_t irq_pin) {
+    self->irq_port = irq_port;
+    self->irq_pin = irq_pin;
+}
+
+bool spi_interface_wait_irq(spi_interface *self, uint32_t timeout_us) {
+    if (!SPI_INTERFACE_HAS_IRQ(self)) {
+        return true;
+    }
+    return nrf24l01_hal_wait_pin(SPI_INTERFACE_IRQ(self), 0, timeout_us);
+}
+
+// Waits for the previous asynchronous command and takes the bus. Returns false, without touching
+// the bus, if either isn't released in time.
+static bool spi_interface_acquire_bus(spi_interface *self) {
+    if (!spi_interface_wait(self)) {
+        return false;
+    }
+
+    if (self->bus != NULL && !spi_bus_acquire(self->bus, self, SPI_INTERFACE_WAIT_TIMEOUT_US)) {
+        NRF24L01_ASSERT(false);
+        return false;
+    }
+    return true;
+}
+
+static void spi_interface_release_bus(spi_interface *self) {
+    if (self->bus != NULL) {
+        spi_bus_release(self->bus, self);
+    }
 }
 
-void spi_interface_send_command(
-        spi_interface *self, uint8_t command, uint8_t *data, uint32_t data_length, uint8_t *output,
+bool spi_interface_set_clock_step(spi_interface *self, uint32_t step, uint32_t *frequency) {
+    // Holding the bus keeps the clock from changing under a transfer of another device
+    if (!spi_interface_acquire_bus(self)) {
+        return false;
+    }
+    uint32_t settings;
+    bool supported = nrf24l01_hal_spi_set_clock_step(SPI_INTERFACE_SPI(self), step, frequency, &settings);
+    if (supported) {
+        self->bus_settings = settings;
+    }
+    spi_interface_release_bus(self);
+    return supported;
+}
+
+// Fills the segments of a command and returns their count (at most 3)
+static uint32_t spi_interface_command_segments(spi_interface_command *command, nrf24l01_hal_spi_segment *segments) {
+    // The command byte goes first, reading STATUS at the same time. Then the data is written
+    // and the output is read directly from/into the caller's buffers.
+    uint32_t segment_count = 0;
+    segments[segment_count++] = (nrf24l01_hal_spi_segment) { &command->command, &command->status, 1, false };
+    if (command->data_length > 0) {
+        segments[segment_count++] = (nrf24l01_hal_spi_segment) { command->data, NULL, command->data_length, false };
+    }
+    if (command->output_length > 0) {
+        segments[segment_count++] = (nrf24l01_hal_spi_segment) { NULL, command->output, command->output_length, false };
+    }
+    return segment_count;
+}
+
+static void spi_interface_transfer_command(spi_interface *self, spi_interface_command *command) {
+    nrf24l01_hal_spi_segment segments[3];
+    uint32_t segment_count = spi_interface_command_segments(command, segments);
+    segments[segment_count - 1].frame_end = true;
+
+    SPI_STATS_START(start);
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CSN(self), 0);
+    nrf24l01_hal_spi_transfer(SPI_INTERFACE_SPI(self), segments, segment_count, UINT32_MAX);
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CSN(self), 1);
+    SPI_STATS_RECORD(start, command->command, 1 + command->data_length + command->output_length);
+}
+
+// Transfers several commands with a single call to the port, which raises CSN between them
+static void spi_interface_transfer_batch(spi_interface *self, spi_interface_command *commands, uint32_t count) {
+    nrf24l01_hal_spi_segment segments[SPI_INTERFACE_BATCH_SEGMENTS];
+    uint32_t segment_count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        segment_count += spi_interface_command_segments(&commands[i], &segments[segment_count]);
+        segments[segment_count - 1].frame_end = true;
+    }
+
+    SPI_STATS_START(start);
+    nrf24l01_hal_spi_transfer(SPI_INTERFACE_SPI(self), segments, segment_count, UINT32_MAX);
+#ifdef NRF24L01_INSTRUMENTATION
+    // The commands share the duration of the batch
+    uint32_t cycles = (nrf24l01_hal_get_cycles() - start) / count;
+    for (uint32_t i = 0; i < count; i++) {
+        spi_stats_record(commands[i].command, 1 + commands[i].data_length + commands[i].output_length, cycles);
+    }
+#endif
+}
+
+uint8_t spi_interface_send_command(
+        spi_interface *self, uint8_t command, const uint8_t *data, uint32_t data_length, uint8_t *output,
+        uint32_t output_length) {
+    spi_interface_command entry = { command, data, data_length, output, output_length, 0 };
+
+    // Don't cut an asynchronous command short
+    if (!spi_interface_acquire_bus(self)) {
+        return SPI_INTERFACE_STATUS_FAILED;
+    }
+    spi_interface_transfer_command(self, &entry);
+    spi_interface_release_bus(self);
+    return entry.status;
+}
+
+void spi_interface_queue_init(spi_interface_queue *self, spi_interface_command *commands, uint32_t capacity) {
+    self->commands = commands;
+    self->capacity = capacity;
+    self->count = 0;
+}
+
+void spi_interface_queue_clear(spi_interface_queue *self) { self->count = 0; }
+
+bool spi_interface_queue_add(
+        spi_interface_queue *self, uint8_t command, const uint8_t *data, uint32_t data_length, uint8_t *output,
         uint32_t output_length) {
-    nrf24l01_hal_write_pin(self->csn_port, self->csn_pin, 0);
+    if (self->count == self->capacity) {
+        return false;
+    }
+
+    self->commands[self->count++] = (spi_interface_command) { command, data, data_length, output, output_length, 0 };
+    return true;
+}
+
+bool spi_interface_run_queue(spi_interface *self, spi_interface_queue *queue) {
+    // The whole queue runs without letting other devices in between
+    if (!spi_interface_acquire_bus(self)) {
+        for (uint32_t i = 0; i < queue->count; i++) {
+            queue->commands[i].status = SPI_INTERFACE_STATUS_FAILED;
+        }
+        return false;
+    }
+
+    if (SPI_INTERFACE_HARDWARE_CSN(self)) {
+        // The port can raise CSN between the commands, so they are handed over in batches
+        uint32_t batch_size = SPI_INTERFACE_BATCH_SEGMENTS / 3;
+        for (uint32_t i = 0; i < queue->count; i += batch_size) {
+            uint32_t count = queue->count - i < batch_size ? queue->count - i : batch_size;
+            spi_interface_transfer_batch(self, &queue->commands[i], count);
+        }
+    } else {
+        for (uint32_t i = 0; i < queue->count; i++) {
+            spi_interface_transfer_command(self, &queue->commands[i]);
+        }
+    }
+    spi_interface_release_bus(self);
+    return true;
+}
 
-    uint8_t buffer[1 + 32];
-    buffer[0] = command;
+void spi_interface_send_command_async(
+        spi_interface *self, uint8_t command, const uint8_t *data, uint32_t data_length, uint8_t *output,
+        uint32_t output_length, spi_interface_callback callback, void *context) {
+    // Without control over CSN, the command byte and the payload can't be split in two transfers
+    if (SPI_INTERFACE_HARDWARE_CSN(self)) {
+        uint8_t status = spi_interface_send_command(self, command, data, data_length, output, output_length);
+        if (callback != NULL) {
+            callback(context, status);
+        }
+        return;
+    }
+
+    if (!spi_interface_acquire_bus(self)) {
+        if (callback != NULL) {
+            callback(context, SPI_INTERFACE_STATUS_FAILED);
+        }
+        return;
+    }
+
+    self->busy = true;
+    self->async_callback = callback;
+    self->async_context = context;
+#ifdef NRF24L01_INSTRUMENTATION
+    self->async_command = command;
+    self->async_start_cycles = nrf24l01_hal_get_cycles();
+#endif
+
+    // Send the command byte right away, reading STATUS at the same time
+    nrf24l01_hal_spi_segment command_segment = { &command, &self->async_status, 1, false };
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CSN(self), 0);
+    nrf24l01_hal_spi_transfer(SPI_INTERFACE_SPI(self), &command_segment, 1, UINT32_MAX);
+
+    // Only one of data or output is used by the nrf24l01 commands
     if (data_length > 0) {
-        memcpy(&buffer[1], data, data_length);
+        self->async_segment = (nrf24l01_hal_spi_segment) { data, NULL, data_length, false };
+    } else if (output_length > 0) {
+        self->async_segment = (nrf24l01_hal_spi_segment) { NULL, output, output_length, false };
+    } else {
+        self->async_segment.size = 0;
+        nrf24l01_hal_spi_transfer_complete(self);
+        return;
+    }
+
+    // Fall back to a blocking transfer if the port can't do it asynchronously
+    if (!nrf24l01_hal_spi_transfer_async(SPI_INTERFACE_SPI(self), &self->async_segment, self)) {
+        nrf24l01_hal_spi_transfer(SPI_INTERFACE_SPI(self), &self->async_segment, 1, UINT32_MAX);
+        nrf24l01_hal_spi_transfer_complete(self);
     }
+}
+
+void nrf24l01_hal_spi_transfer_complete(void *context) {
+    spi_interface *self = context;
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CSN(self), 1);
+    SPI_STATS_RECORD(self->async_start_cycles, self->async_command, 1 + self->async_segment.size);
+    spi_interface_release_bus(self);
+
+    // The callback may start the next command, so the state is released before calling it
+    spi_interface_callback callback = self->async_callback;
+    void *callback_context = self->async_context;
+    uint8_t status = self->async_status;
+    self->busy = false;
+
+    if (callback != NULL) {
+        callback(callback_context, status);
+    }
+}
 
-    // Write the command and the data
-    nrf24l01_hal_spi_transmit(self->spi, buffer, data_length + 1, UINT32_MAX);
+bool spi_interface_is_busy(spi_interface *self) { return self->busy; }
 
-    // Read the output
-    if (output_length > 0) {
-        nrf24l01_hal_spi_receive(self->spi, output, output_length, UINT32_MAX);
+bool spi_interface_wait(spi_interface *self) {
+    if (!self->busy) {
+        return true;
     }
 
-    nrf24l01_hal_write_pin(self->csn_port, self->csn_pin, 1);
+    uint32_t start = nrf24l01_hal_get_us_ticks();
+    while (self->busy) {
+        if (nrf24l01_hal_elapsed_us(start) >= SPI_INTERFACE_WAIT_TIMEOUT_US) {
+            NRF24L01_ASSERT(false);
+            return false;
+        }
+        nrf24l01_hal_idle();
+    }
+    return true;
 }
 
 void spi_interface_pulse_ce(spi_interface *self) {
-    nrf24l01_hal_write_pin(self->ce_port, self->ce_pin, 1);
-    nrf24l01_hal_sleep_us(15);
-    nrf24l01_hal_write_pin(self->ce_port, self->ce_pin, 0);
+    // A slow idle hook would keep CE high, and the device transmitting (ex. a reused payload)
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CE(self), 1);
+    nrf24l01_hal_delay_us(15);
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CE(self), 0);
+    self->ce_state = false;
 }
 
 void spi_interface_enable_ce(spi_interface *self) {
-    nrf24l01_hal_write_pin(self->ce_port, self->ce_pin, 1);
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CE(self), 1);
+    self->ce_state = true;
 }
 
 void spi_interface_disable_ce(spi_interface *self) {
-    nrf24l01_hal_write_pin(self->ce_port, self->ce_pin, 0);
+    nrf24l01_hal_write_pin(SPI_INTERFACE_CE(self), 0);
+    self->ce_state = false;
 }
+
+bool spi_interface_get_ce(spi_interface *self) { return self->ce_state; }
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "spi_interface.h"
+
+/**
+ * Maximum number of devices that can share a single SPI bus.
+ */
+#define SPI_BUS_MAX_DEVICES 6
+
+/**
+ * Arbiter for a SPI peripheral shared by several nRF24l01 devices, each with its own CSN and CE
+ * pins. Transactions of different devices are serialized, the SPI settings of each device are
+ * applied when it takes over the bus, and queues submitted by the devices are scheduled fairly.
+ * NOTE that acquiring the bus spins while another context holds it, so interrupt handlers should
+ * submit queues with spi_bus_submit instead of sending commands directly.
+ */
+typedef struct spi_bus {
+    void *spi;
+    volatile bool locked;
+    spi_interface *owner;
+    spi_interface *devices[SPI_BUS_MAX_DEVICES];
+    spi_interface_queue *volatile pending[SPI_BUS_MAX_DEVICES];
+    uint32_t device_count;
+    uint32_t next_device;
+} spi_bus;
+
+/**
+ * Initializes a shared SPI bus. Requires the SPI peripheral to be initialized beforehand.
+ * @param self The spi_bus struct to initialize.
+ * @param spi The SPI peripheral to share.
+ */
+void spi_bus_init(spi_bus *self, void *spi);
+
+/**
+ * Registers a device to the bus. Called by spi_interface_init_shared.
+ * @param self The spi_bus struct to act upon.
+ * @param device The spi_interface of the device.
+ * @return False if the bus already has SPI_BUS_MAX_DEVICES devices, true otherwise.
+ */
+bool spi_bus_register(spi_bus *self, spi_interface *device);
+
+/**
+ * Takes ownership of the bus for the given device if no other transaction is in progress.
+ * The SPI settings of the device are applied if another device used the bus last.
+ * @param self The spi_bus struct to act upon.
+ * @param device The spi_interface of the device.
+ * @return True if the bus was acquired, false if it is in use.
+ */
+bool spi_bus_try_acquire(spi_bus *self, spi_interface *device);
+
+/**
+ * Takes ownership of the bus for the given device, waiting for any transaction in progress.
+ * The idle hook runs while waiting (see nrf24l01_hal_idle). Must not be called from an
+ * interrupt that may have preempted the owner of the bus, which then can't release it.
+ * @param self The spi_bus struct to act upon.
+ * @param device The spi_interface of the device.
+ * @param timeout_us The maximum number of microseconds to wait (UINT32_MAX to wait indefinitely).
+ * @return True if the bus was acquired, false if the timeout expired.
+ */
+bool spi_bus_acquire(spi_bus *self, spi_interface *device, uint32_t timeout_us);
+
+/**
+ * Gives up ownership of the bus. Does nothing if the bus is held by another device. Safe to call
+ * from interrupt context.
+ * @param self The spi_bus struct to act upon.
+ * @param device The spi_interface of the device that acquired the bus.
+ */
+void spi_bus_release(spi_bus *self, spi_interface *device);
+
+/**
+ * Schedules a queue of commands to be sent to the given device by spi_bus_run. Each device can
+ * have one pending queue at a time. Safe to call from interrupt context.
+ * @param self The spi_bus struct to act upon.
+ * @param device The spi_interface of the device.
+ * @param queue The queue of commands. Must stay valid until it has run.
+ * @return False if the device is not registered or already has a pending queue, true otherwise.
+ */
+bool spi_bus_submit(spi_bus *self, spi_interface *device, spi_interface_queue *queue);
+
+/**
+ * @param self The spi_bus struct to act upon.
+ * @param queue A queue given to spi_bus_submit.
+ * @return True if the queue has not run yet.
+ */
+bool spi_bus_is_pending(spi_bus *self, spi_interface_queue *queue);
+
+/**
+ * Runs the pending queues of all devices. Devices are served in round-robin order, starting
+ * after the device served last, so that no device is starved.
+ * @param self The spi_bus struct to act upon.
+ * @return The number of queues that were run.
+ */
+uint32_t spi_bus_run(spi_bus *self);
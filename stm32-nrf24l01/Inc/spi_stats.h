@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "nrf24l01_hal.h"
+
+// Per-command latency statistics of the SPI transactions. Only compiled when NRF24L01_INSTRUMENTATION
+// is defined, otherwise recording compiles to nothing and the functions below do nothing.
+
+/**
+ * Maximum number of distinct command bytes that are tracked. Transactions of further commands
+ * are only counted in spi_stats_dropped.
+ */
+#define SPI_STATS_MAX_COMMANDS 32
+
+/**
+ * Number of buckets of the latency histogram of each command. Bucket 0 counts the transactions
+ * shorter than 2^SPI_STATS_HISTOGRAM_MIN_BITS cycles, each next bucket twice as long ones, and
+ * the last bucket all the longer ones.
+ */
+#define SPI_STATS_HISTOGRAM_BUCKETS 12
+#define SPI_STATS_HISTOGRAM_MIN_BITS 7
+
+/**
+ * Statistics of the transactions sent with a single command byte.
+ */
+typedef struct {
+    uint8_t command;       // The command byte. Ex. COMMAND_CODE_R_REGISTER | REGISTER_ADDRESS_STATUS
+    uint32_t count;        // Number of transactions
+    uint32_t min_cycles;   // Shortest transaction
+    uint32_t max_cycles;   // Longest transaction
+    uint64_t total_cycles; // Sum of the durations of all transactions (mean = total_cycles / count)
+    uint32_t total_bytes;  // Sum of the bytes of all transactions, command byte included
+    // Transactions by duration, to tell the outliers from the usual latency
+    uint32_t histogram[SPI_STATS_HISTOGRAM_BUCKETS];
+} spi_stats_entry;
+
+#ifdef NRF24L01_INSTRUMENTATION
+
+/**
+ * Adds a transaction to the statistics. Called by spi_interface, also from the interrupt
+ * completing an asynchronous transfer.
+ * @param command The command byte of the transaction.
+ * @param bytes The number of bytes of the transaction, command byte included.
+ * @param cycles The duration of the transaction in nrf24l01_hal_get_cycles units.
+ */
+void spi_stats_record(uint8_t command, uint32_t bytes, uint32_t cycles);
+
+/**
+ * @param command The command byte to get the statistics of. For register accesses, combine the
+ *                command code and the register address. Ex. COMMAND_CODE_W_REGISTER | REGISTER_ADDRESS_RF_CH
+ * @return The statistics of the command, or NULL if it has not been recorded.
+ */
+const spi_stats_entry *spi_stats_get(uint8_t command);
+
+/**
+ * @return The number of transactions that were not recorded because SPI_STATS_MAX_COMMANDS
+ *         distinct commands were already tracked.
+ */
+uint32_t spi_stats_dropped();
+
+/**
+ * Clears all statistics.
+ */
+void spi_stats_reset();
+
+/**
+ * Prints the statistics of all recorded commands with printf.
+ */
+void spi_stats_dump();
+
+#define SPI_STATS_START(name) uint32_t name = nrf24l01_hal_get_cycles()
+#define SPI_STATS_RECORD(start, command, bytes) spi_stats_record(command, bytes, nrf24l01_hal_get_cycles() - (start))
+
+#else
+
+static inline const spi_stats_entry *spi_stats_get(uint8_t command) {
+    (void) command;
+    return 0;
+}
+
+static inline uint32_t spi_stats_dropped() { return 0; }
+
+static inline void spi_stats_reset() {}
+
+static inline void spi_stats_dump() {}
+
+#define SPI_STATS_START(name)
+#define SPI_STATS_RECORD(start, command, bytes)
+
+#endif
@@ -5,40 +5,188 @@
 
 #include "nrf24l01_hal.h"
 
-bool nrf24l01_init(
-        nrf24l01 *self, uint8_t *address_prefix, void *spi, void *csn_port, uint16_t csn_pin,
-        void *ce_port, uint16_t ce_pin) {
-    spi_interface_init(&self->spi_handler, spi, csn_port, csn_pin, ce_port, ce_pin);
-    device_commands_init(&self->commands_handler, &self->spi_handler);
-
-    // Allow NO-ACK packets
-    device_commands_set_en_dyn_ack(&self->commands_handler, 1);
-
-    // Enable dynamic packet width
-    device_commands_set_en_dpl(&self->commands_handler, 1);
+static nrf24l01_idle_hook idle_hook = NULL;
+static void *idle_hook_context = NULL;
 
-    // Disable all pipes
-    for (int i = 0; i < 6; i++) {
-        device_commands_set_erx(&self->commands_handler, i, 0);
-    }
+static bool nrf24l01_configure(nrf24l01 *self, uint8_t *address_prefix) {
+    device_commands_init(&self->commands_handler, &self->spi_handler);
+    nrf24l01_reset_tx_stats(self);
+    self->ack_payload_callback = NULL;
+    memset(self->pipe_handlers, 0, sizeof(self->pipe_handlers));
+
+    // Start with the current configuration in the register cache
+    device_commands_resync_cache(&self->commands_handler);
+
+    // Configure the features, the addresses and empty the FIFOs in one pass
+    spi_interface_command commands[13];
+    spi_interface_queue queue;
+    spi_interface_queue_init(&queue, commands, 13);
+
+    // Allow NO-ACK packets and payloads in the ACKs, and enable dynamic packet width
+    device_commands_register_update feature;
+    device_commands_update_begin(&feature, REGISTER_ADDRESS_FEATURE);
+    device_commands_update_field(&feature, DEVICE_COMMANDS_FIELD_EN_DYN_ACK, 0, 1);
+    device_commands_update_field(&feature, DEVICE_COMMANDS_FIELD_EN_ACK_PAY, 0, 1);
+    device_commands_update_field(&feature, DEVICE_COMMANDS_FIELD_EN_DPL, 0, 1);
+    device_commands_queue_update(&self->commands_handler, &queue, &feature);
+
+    // Disable all pipes, with auto acknowledgment until configured otherwise
+    uint8_t en_rxaddr = 0x00;
+    uint8_t en_aa = 0x3F;
+    device_commands_queue_write_register(&queue, REGISTER_ADDRESS_EN_RXADDR, &en_rxaddr, 1);
+    device_commands_queue_write_register(&queue, REGISTER_ADDRESS_EN_AA, &en_aa, 1);
+
+    // Use 5-byte addresses until nrf24l01_set_address_width is called
+    uint8_t setup_aw = 0x03;
+    device_commands_queue_write_register(&queue, REGISTER_ADDRESS_SETUP_AW, &setup_aw, 1);
 
     // Set RX pipe address 0, 1 and TX address to address_prefix + 0x00
     uint8_t address[5];
     memcpy(address, address_prefix, 4);
     address[4] = 0x00;
-    device_commands_set_tx_addr_full(&self->commands_handler, address);
-    device_commands_set_rx_addr_full(&self->commands_handler, 0, address);
-    device_commands_set_rx_addr_full(&self->commands_handler, 1, address);
+    device_commands_queue_write_register(&queue, REGISTER_ADDRESS_TX_ADDR, address, 5);
+    device_commands_queue_write_register(&queue, REGISTER_ADDRESS_RX_ADDR_P0, address, 5);
+    device_commands_queue_write_register(&queue, REGISTER_ADDRESS_RX_ADDR_P0 + 1, address, 5);
 
     // Reset other pipe addresses
     for (int i = 2; i < 6; i++) {
-        device_commands_set_rx_addr_lsb(&self->commands_handler, i, 0x00);
+        device_commands_queue_write_register(&queue, REGISTER_ADDRESS_RX_ADDR_P0 + i, &address[4], 1);
     }
 
     // Flush TX/RX FIFO
-    device_commands_flush_tx(&self->commands_handler);
-    device_commands_flush_rx(&self->commands_handler);
+    spi_interface_queue_add(&queue, COMMAND_CODE_FLUSH_TX, NULL, 0, NULL, 0);
+    spi_interface_queue_add(&queue, COMMAND_CODE_FLUSH_RX, NULL, 0, NULL, 0);
+
+    device_commands_run_queue(&self->commands_handler, &queue);
+
+    return true;
+}
+
+bool nrf24l01_init(
+        nrf24l01 *self, uint8_t *address_prefix, void *spi, void *csn_port, uint16_t csn_pin,
+        void *ce_port, uint16_t ce_pin) {
+    spi_interface_init(&self->spi_handler, spi, csn_port, csn_pin, ce_port, ce_pin);
+    return nrf24l01_configure(self, address_prefix);
+}
 
+bool nrf24l01_init_shared(
+        nrf24l01 *self, uint8_t *address_prefix, spi_bus *bus, uint32_t bus_settings, void *csn_port,
+        uint16_t csn_pin, void *ce_port, uint16_t ce_pin) {
+    if (!spi_interface_init_shared(&self->spi_handler, bus, bus_settings, csn_port, csn_pin, ce_port, ce_pin)) {
+        return false;
+    }
+    return nrf24l01_configure(self, address_prefix);
+}
+
+void nrf24l01_resync_registers(nrf24l01 *self) { device_commands_resync_cache(&self->commands_handler); }
+
+void nrf24l01_set_irq_pin(nrf24l01 *self, void *irq_port, uint16_t irq_pin) {
+    spi_interface_set_irq_pin(&self->spi_handler, irq_port, irq_pin);
+}
+
+void nrf24l01_set_irq_events(nrf24l01 *self, uint8_t events) {
+    // A set MASK_* bit keeps the event off the IRQ pin
+    device_commands_register_update config;
+    device_commands_update_begin(&config, REGISTER_ADDRESS_CONFIG);
+    device_commands_update_field(&config, DEVICE_COMMANDS_FIELD_MASK_RX_DR, 0, !(events & STATUS_MASK_RX_DR));
+    device_commands_update_field(&config, DEVICE_COMMANDS_FIELD_MASK_TX_DS, 0, !(events & STATUS_MASK_TX_DS));
+    device_commands_update_field(&config, DEVICE_COMMANDS_FIELD_MASK_MAX_RT, 0, !(events & STATUS_MASK_MAX_RT));
+    device_commands_update_commit(&self->commands_handler, &config);
+}
+
+uint8_t nrf24l01_get_irq_events(nrf24l01 *self) {
+    // The MASK_* bits of CONFIG sit at the positions of the events in STATUS
+    uint8_t config;
+    device_commands_read_register_cached(&self->commands_handler, REGISTER_ADDRESS_CONFIG, &config);
+    return ~config & STATUS_MASK_EVENTS;
+}
+
+// Whether the IRQ pin (if any) can be waited on for the given events: none of them is masked, so
+// the pin is sure to go low when they happen.
+static bool nrf24l01_irq_usable(nrf24l01 *self, uint8_t events) {
+    return (nrf24l01_get_irq_events(self) & events) == events;
+}
+
+void nrf24l01_set_idle_hook(nrf24l01_idle_hook hook, void *context) {
+    idle_hook_context = context;
+    idle_hook = hook;
+}
+
+void nrf24l01_hal_idle() {
+    if (idle_hook != NULL) {
+        idle_hook(idle_hook_context);
+    }
+}
+
+// Checks that a series of patterns written to TX_ADDR read back unchanged
+static bool nrf24l01_verify_spi(nrf24l01 *self) {
+    static const uint8_t patterns[][5] = {
+        {0x00, 0x00, 0x00, 0x00, 0x00},
+        {0xFF, 0xFF, 0xFF, 0xFF, 0xFF},
+        {0xAA, 0x55, 0xAA, 0x55, 0xAA},
+        {0x55, 0xAA, 0x55, 0xAA, 0x55},
+        {0x01, 0x02, 0x04, 0x08, 0x10},
+        {0xFE, 0xFD, 0xFB, 0xF7, 0xEF},
+    };
+
+    // Only the bytes of the configured address width are transferred
+    uint8_t width = device_commands_get_address_width(&self->commands_handler);
+    for (int repeat = 0; repeat < 8; repeat++) {
+        for (uint32_t i = 0; i < sizeof(patterns) / sizeof(patterns[0]); i++) {
+            uint8_t readback[5];
+            device_commands_set_tx_addr_full(&self->commands_handler, (uint8_t *) patterns[i]);
+            device_commands_get_tx_addr_full(&self->commands_handler, readback);
+            if (memcmp(readback, patterns[i], width) != 0) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool nrf24l01_calibrate_spi_clock(nrf24l01 *self, uint32_t margin_steps, nrf24l01_spi_calibration *result) {
+    // Save TX_ADDR at the slowest clock. A port without clock steps has nothing to calibrate.
+    uint32_t frequency;
+    uint8_t tx_address[5];
+    if (!spi_interface_set_clock_step(&self->spi_handler, 0, &frequency)) {
+        return false;
+    }
+    device_commands_get_tx_addr_full(&self->commands_handler, tx_address);
+    if (!nrf24l01_verify_spi(self)) {
+        device_commands_set_tx_addr_full(&self->commands_handler, tx_address);
+        device_commands_resync_cache(&self->commands_handler);
+        return false;
+    }
+
+    // Step up the clock until verification fails
+    uint32_t fastest_step = 0;
+    uint32_t fastest_frequency = frequency;
+    for (uint32_t step = 1; spi_interface_set_clock_step(&self->spi_handler, step, &frequency); step++) {
+        if (frequency > NRF24L01_SPI_MAX_FREQUENCY || !nrf24l01_verify_spi(self)) {
+            break;
+        }
+        fastest_step = step;
+        fastest_frequency = frequency;
+    }
+
+    // Back off by the margin and restore TX_ADDR. The failed steps may have garbled other
+    // registers behind the cache, so it is read again at the final clock.
+    uint32_t step = fastest_step > margin_steps ? fastest_step - margin_steps : 0;
+    bool applied = spi_interface_set_clock_step(&self->spi_handler, step, &frequency);
+    device_commands_set_tx_addr_full(&self->commands_handler, tx_address);
+    device_commands_resync_cache(&self->commands_handler);
+    if (!applied) {
+        return false;
+    }
+
+    if (result != NULL) {
+        result->step = step;
+        result->frequency = frequency;
+        result->fastest_step = fastest_step;
+        result->fastest_frequency = fastest_frequency;
+        result->margin_steps = fastest_step - step;
+    }
     return true;
 }
 
@@ -52,25 +200,61 @@ void nrf24l01_power_up(nrf24l01 *self) {
     device_commands_set_pwr_up(&self->commands_handler, 1);
 
     // Wait for the Tpd2stby delay
-    nrf24l01_hal_sleep_ms(5);
+    nrf24l01_hal_sleep_us(5000);
 }
 
 void nrf24l01_power_down(nrf24l01 *self) { device_commands_set_pwr_up(&self->commands_handler, 0); }
 
-void nrf24l01_set_pipe0_write(nrf24l01 *self, uint8_t address) {
-    device_commands_set_tx_addr_lsb(&self->commands_handler, address);
+// Enables the given pipe with dynamic payload length. The whole configuration is written in one
+// pass, the registers shared between pipes being updated on top of their cached values.
+static void nrf24l01_configure_pipe(
+        nrf24l01 *self, uint32_t pipe, uint8_t address, uint8_t payload_width, bool set_tx_address, bool auto_ack) {
+    // Enable dynamic payload width, auto acknowledgment (if requested) and reception on the pipe
+    device_commands_register_update dynpd, en_aa, en_rxaddr;
+    device_commands_update_begin(&dynpd, REGISTER_ADDRESS_DYNPD);
+    device_commands_update_field(&dynpd, DEVICE_COMMANDS_FIELD_DPL, pipe, 1);
+    device_commands_update_begin(&en_aa, REGISTER_ADDRESS_EN_AA);
+    device_commands_update_field(&en_aa, DEVICE_COMMANDS_FIELD_ENAA, pipe, auto_ack);
+    device_commands_update_begin(&en_rxaddr, REGISTER_ADDRESS_EN_RXADDR);
+    device_commands_update_field(&en_rxaddr, DEVICE_COMMANDS_FIELD_ERX, pipe, 1);
+
+    spi_interface_command commands[6];
+    spi_interface_queue queue;
+    spi_interface_queue_init(&queue, commands, 6);
+    if (set_tx_address) {
+        device_commands_queue_write_register(&queue, REGISTER_ADDRESS_TX_ADDR, &address, 1);
+    }
+    device_commands_queue_write_register(&queue, REGISTER_ADDRESS_RX_ADDR_P0 + pipe, &address, 1);
+    device_commands_queue_write_register(&queue, REGISTER_ADDRESS_RX_PW_P0 + pipe, &payload_width, 1);
+    device_commands_queue_update(&self->commands_handler, &queue, &dynpd);
+    device_commands_queue_update(&self->commands_handler, &queue, &en_aa);
+    device_commands_queue_update(&self->commands_handler, &queue, &en_rxaddr);
+    device_commands_run_queue(&self->commands_handler, &queue);
+}
 
-    device_commands_set_rx_addr_lsb(&self->commands_handler, 0, address);
-    device_commands_set_rx_pw(&self->commands_handler, 0, 0);
-    device_commands_set_dpl(&self->commands_handler, 0, 1);
-    device_commands_set_erx(&self->commands_handler, 0, 1);
+void nrf24l01_set_pipe0_write(nrf24l01 *self, uint8_t address) {
+    nrf24l01_configure_pipe(self, 0, address, 0, true, true);
 }
 
 void nrf24l01_set_pipe_read(nrf24l01 *self, uint32_t pipe, uint8_t address) {
-    device_commands_set_rx_addr_lsb(&self->commands_handler, pipe, address);
-    device_commands_set_rx_pw(&self->commands_handler, pipe, 32);
-    device_commands_set_dpl(&self->commands_handler, pipe, 1);
-    device_commands_set_erx(&self->commands_handler, pipe, 1);
+    nrf24l01_configure_pipe(self, pipe, address, 32, false, true);
+}
+
+void nrf24l01_set_pipe_read_no_ack(nrf24l01 *self, uint32_t pipe, uint8_t address) {
+    nrf24l01_configure_pipe(self, pipe, address, 32, false, false);
+}
+
+uint8_t nrf24l01_get_address_width(nrf24l01 *self) {
+    return device_commands_get_address_width(&self->commands_handler);
+}
+
+void nrf24l01_set_address_width(nrf24l01 *self, uint8_t width) {
+    if (width < 3 || width > 5) {
+        printf("Valid address width range: [3, 5]. Given is %d\r\n", width);
+        return;
+    }
+
+    device_commands_set_aw(&self->commands_handler, width - 2);
 }
 
 uint8_t nrf24l01_get_channel(nrf24l01 *self) {
@@ -88,6 +272,42 @@ void nrf24l01_set_channel(nrf24l01 *self, uint8_t channel) {
     device_commands_set_rf_ch(&self->commands_handler, channel);
 }
 
+void nrf24l01_scan_channels(nrf24l01 *self, uint32_t sweeps, uint32_t *histogram) {
+    uint8_t channel;
+    bool prim_rx;
+    bool ce = spi_interface_get_ce(&self->spi_handler);
+    device_commands_get_rf_ch(&self->commands_handler, &channel);
+    device_commands_get_prim_rx(&self->commands_handler, &prim_rx);
+
+    // Set RX mode, from standby so that every channel is listened to from a fresh start
+    spi_interface_disable_ce(&self->spi_handler);
+    device_commands_set_prim_rx(&self->commands_handler, 1);
+
+    for (uint32_t sweep = 0; sweep < sweeps; sweep++) {
+        for (uint8_t i = 0; i < NRF24L01_CHANNEL_COUNT; i++) {
+            // RF_CH holds no other field and is cached, so this is a single write
+            device_commands_set_rf_ch(&self->commands_handler, i);
+
+            // Listen, then latch RPD by leaving RX mode
+            spi_interface_enable_ce(&self->spi_handler);
+            nrf24l01_hal_sleep_us(NRF24L01_SCAN_DWELL_US);
+            spi_interface_disable_ce(&self->spi_handler);
+
+            bool rpd;
+            device_commands_get_rpd(&self->commands_handler, &rpd);
+            histogram[i] += rpd;
+        }
+    }
+
+    // Restore the previous state. The RX FIFO is left alone, so no packet received before the
+    // scan is lost.
+    device_commands_set_rf_ch(&self->commands_handler, channel);
+    device_commands_set_prim_rx(&self->commands_handler, prim_rx);
+    if (ce) {
+        spi_interface_enable_ce(&self->spi_handler);
+    }
+}
+
 DataRate nrf24l01_get_data_rate(nrf24l01 *self) {
     // Get RF_DR_LOW and RF_DR_HIGH
     bool rf_dr_low, rf_dr_high;
@@ -105,13 +325,13 @@ DataRate nrf24l01_get_data_rate(nrf24l01 *self) {
 }
 
 void nrf24l01_set_data_rate(nrf24l01 *self, DataRate data_rate) {
-    // Set RF_DR_LOW
-    bool rf_dr_low = data_rate == DATA_RATE_LOW;
-    device_commands_set_rf_dr_low(&self->commands_handler, rf_dr_low);
-
-    // Set RF_DR_HIGH
-    bool rf_dr_high = data_rate == DATA_RATE_HIGH;
-    device_commands_set_rf_dr_high(&self->commands_handler, rf_dr_high);
+    // Set RF_DR_LOW and RF_DR_HIGH with a single write, to never go through
+    // an invalid combination of the two
+    device_commands_register_update rf_setup;
+    device_commands_update_begin(&rf_setup, REGISTER_ADDRESS_RF_SETUP);
+    device_commands_update_field(&rf_setup, DEVICE_COMMANDS_FIELD_RF_DR_LOW, 0, data_rate == DATA_RATE_LOW);
+    device_commands_update_field(&rf_setup, DEVICE_COMMANDS_FIELD_RF_DR_HIGH, 0, data_rate == DATA_RATE_HIGH);
+    device_commands_update_commit(&self->commands_handler, &rf_setup);
 }
 
 PowerLevel nrf24l01_get_power_level(nrf24l01 *self) {
@@ -179,34 +399,109 @@ void nrf24l01_send_packet(nrf24l01 *self, uint8_t *packet, uint8_t packet_length
     nrf24l01_send_packets(self, packets, 1, lengths, resend_lost_packet);
 }
 
+void nrf24l01_get_tx_stats(nrf24l01 *self, nrf24l01_tx_stats *stats) { *stats = self->tx_stats; }
+
+void nrf24l01_reset_tx_stats(nrf24l01 *self) { memset(&self->tx_stats, 0, sizeof(self->tx_stats)); }
+
+void nrf24l01_set_ack_payload_callback(nrf24l01 *self, nrf24l01_ack_payload_callback callback, void *context) {
+    self->ack_payload_context = context;
+    self->ack_payload_callback = callback;
+}
+
+// Reads the payloads received with the ACKs, as long as the RX FIFO is not empty
+static void nrf24l01_read_ack_payloads(nrf24l01 *self) {
+    while (true) {
+        uint8_t payload_width;
+        uint8_t status = device_commands_r_rx_pl_wid(&self->commands_handler, &payload_width);
+        if ((status & STATUS_MASK_RX_P_NO) == STATUS_MASK_RX_P_NO) {
+            break;
+        }
+
+        // Flush RX if the payload is bigger than 32 bytes
+        if (payload_width > 32) {
+            device_commands_flush_rx(&self->commands_handler);
+            break;
+        }
+
+        uint8_t payload[32];
+        device_commands_r_rx_payload(&self->commands_handler, payload, payload_width);
+        if (self->ack_payload_callback != NULL) {
+            self->ack_payload_callback(payload, payload_width, self->ack_payload_context);
+        }
+    }
+}
+
+// Clears the TX_DS or MAX_RT event of the current packet (along with RX_DR if given) and adds it
+// to the statistics. With CE high, the device starts the next packet of the TX FIFO right after the
+// ACK and resets ARC_CNT then, so ARC_CNT only surely belongs to the finished packet after MAX_RT
+// (the device stops until it is cleared) or when the TX FIFO is empty. FIFO_STATUS is read in the
+// same pass to tell, no payload being written in between.
+static void nrf24l01_finish_packet(nrf24l01 *self, uint8_t event) {
+    uint8_t fifo_status, observe_tx;
+    spi_interface_command commands[3];
+    spi_interface_queue queue;
+    spi_interface_queue_init(&queue, commands, 3);
+    device_commands_queue_read_register(&queue, REGISTER_ADDRESS_FIFO_STATUS, &fifo_status, 1);
+    device_commands_queue_read_register(&queue, REGISTER_ADDRESS_OBSERVE_TX, &observe_tx, 1);
+    device_commands_queue_write_register(&queue, REGISTER_ADDRESS_STATUS, &event, 1);
+    device_commands_run_queue(&self->commands_handler, &queue);
+
+    if (event & STATUS_MASK_TX_DS) {
+        self->tx_stats.packets_acked++;
+    } else {
+        self->tx_stats.packets_lost++;
+    }
+
+    if (!(event & STATUS_MASK_MAX_RT) && !(fifo_status & FIFO_STATUS_MASK_TX_EMPTY)) {
+        self->tx_stats.packets_unmeasured++;
+        return;
+    }
+
+    uint8_t arc_cnt = (observe_tx & device_commands_field_mask(DEVICE_COMMANDS_FIELD_ARC_CNT, 0))
+                      >> device_commands_field_offset(DEVICE_COMMANDS_FIELD_ARC_CNT, 0);
+    self->tx_stats.retransmits += arc_cnt;
+    if (event & STATUS_MASK_TX_DS) {
+        self->tx_stats.retransmit_histogram[arc_cnt]++;
+    }
+}
+
 void nrf24l01_send_packets(
         nrf24l01 *self, uint8_t **value, int count, uint8_t *packet_lengths, bool resend_lost_packets) {
     // Set TX mode
     device_commands_set_prim_rx(&self->commands_handler, 0);
 
-    // Clear any leftover packets
-    device_commands_flush_tx(&self->commands_handler);
-
-    // Preload the FIFO clamp
+    // Clear any leftover packets, so the RX FIFO only gets ACK payloads, and preload the FIFO clamp
+    // in one pass
     int preload_count = (count > 3 ? 3 : count);
+    spi_interface_command commands[5];
+    spi_interface_queue queue;
+    spi_interface_queue_init(&queue, commands, 5);
+    spi_interface_queue_add(&queue, COMMAND_CODE_FLUSH_TX, NULL, 0, NULL, 0);
+    spi_interface_queue_add(&queue, COMMAND_CODE_FLUSH_RX, NULL, 0, NULL, 0);
     for (int i = 0; i < preload_count; i++) {
-        // Write the payload
-        device_commands_w_tx_payload(&self->commands_handler, value[i], packet_lengths[i]);
+        device_commands_queue_w_tx_payload(&queue, value[i], packet_lengths[i]);
     }
+    device_commands_run_queue(&self->commands_handler, &queue);
 
     // Start sending
+    bool use_irq = nrf24l01_irq_usable(self, STATUS_MASK_TX_DS | STATUS_MASK_MAX_RT);
     spi_interface_enable_ce(&self->spi_handler);
     for (int i = 0; i < count; i++) {
         // Wait for TX_DS or MAX_RT
         while (true) {
-            bool tx_ds;
-            device_commands_get_tx_ds(&self->commands_handler, &tx_ds);
+            // Only read STATUS once the IRQ pin (if usable) signals an event
+            if (use_irq && !spi_interface_wait_irq(&self->spi_handler, UINT32_MAX)) {
+                continue;
+            }
 
-            bool max_rt;
-            device_commands_get_max_rt(&self->commands_handler, &max_rt);
+            uint8_t status = device_commands_nop(&self->commands_handler);
 
-            if (tx_ds) {
-                device_commands_clear_tx_ds(&self->commands_handler);
+            if (status & STATUS_MASK_TX_DS) {
+                // Payloads received with the ACK wait in the RX FIFO (RX_P_NO tells if it's empty)
+                if ((status & STATUS_MASK_RX_P_NO) != STATUS_MASK_RX_P_NO) {
+                    nrf24l01_read_ack_payloads(self);
+                }
+                nrf24l01_finish_packet(self, STATUS_MASK_TX_DS | (status & STATUS_MASK_RX_DR));
 
                 // Send the next packet if it exists
                 if (i + preload_count < count) {
@@ -216,12 +511,12 @@ void nrf24l01_send_packets(
                 }
                 break;
             }
-            if (max_rt) {
+            if (status & STATUS_MASK_MAX_RT) {
                 if (!resend_lost_packets) {
                     spi_interface_disable_ce(&self->spi_handler);
                 }
 
-                device_commands_clear_max_rt(&self->commands_handler);
+                nrf24l01_finish_packet(self, STATUS_MASK_MAX_RT);
 
                 if (!resend_lost_packets) {
                     device_commands_flush_tx(&self->commands_handler);
@@ -245,6 +540,31 @@ void nrf24l01_send_packets(
     spi_interface_disable_ce(&self->spi_handler);
 }
 
+typedef struct {
+    uint8_t *payload;
+    uint8_t payload_length;
+} nrf24l01_ack_payload_capture;
+
+static void nrf24l01_capture_ack_payload(uint8_t *payload, uint8_t payload_length, void *context) {
+    nrf24l01_ack_payload_capture *capture = context;
+    memcpy(capture->payload, payload, payload_length);
+    capture->payload_length = payload_length;
+}
+
+uint8_t nrf24l01_send_packet_ack_payload(
+        nrf24l01 *self, uint8_t *packet, uint8_t packet_length, bool resend_lost_packet, uint8_t *ack_payload) {
+    // Capture the ACK payload instead of handing it to the callback
+    nrf24l01_ack_payload_callback callback = self->ack_payload_callback;
+    void *context = self->ack_payload_context;
+    nrf24l01_ack_payload_capture capture = { ack_payload, 0 };
+    nrf24l01_set_ack_payload_callback(self, nrf24l01_capture_ack_payload, &capture);
+
+    nrf24l01_send_packet(self, packet, packet_length, resend_lost_packet);
+
+    nrf24l01_set_ack_payload_callback(self, callback, context);
+    return capture.payload_length;
+}
+
 void nrf24l01_send_packet_no_ack(nrf24l01 *self, uint8_t *packet, uint8_t packet_length) {
     uint8_t *packets[] = { packet };
     uint8_t lengths[] = { packet_length };
@@ -266,14 +586,19 @@ void nrf24l01_send_packets_no_ack(nrf24l01 *self, uint8_t **value, int count, ui
     }
 
     // Send the packets
+    bool use_irq = nrf24l01_irq_usable(self, STATUS_MASK_TX_DS);
     spi_interface_enable_ce(&self->spi_handler);
     for (int i = 0; i < count; i++) {
         // Wait for TX_DS
         while (true) {
-            bool tx_ds;
-            device_commands_get_tx_ds(&self->commands_handler, &tx_ds);
-            if (tx_ds) {
-                device_commands_clear_tx_ds(&self->commands_handler);
+            // Only read STATUS once the IRQ pin (if usable) signals an event
+            if (use_irq && !spi_interface_wait_irq(&self->spi_handler, UINT32_MAX)) {
+                continue;
+            }
+
+            uint8_t status = device_commands_nop(&self->commands_handler);
+            if (status & STATUS_MASK_TX_DS) {
+                device_commands_clear_status(&self->commands_handler, STATUS_MASK_TX_DS);
 
                 if (i + preload_count < count) {
                     // Write the payload
@@ -289,41 +614,112 @@ void nrf24l01_send_packets_no_ack(nrf24l01 *self, uint8_t **value, int count, ui
     spi_interface_disable_ce(&self->spi_handler);
 }
 
-int nrf24l01_receive_packet(nrf24l01 *self, uint8_t *packet, uint32_t timeout) {
-    uint8_t *packets[] = { packet };
-    return nrf24l01_receive_packets(self, packets, 1, timeout);
+uint32_t nrf24l01_send_beacon(
+        nrf24l01 *self, uint8_t *packet, uint8_t packet_length, uint32_t count, uint32_t interval_us,
+        nrf24l01_beacon_stop stop, void *context) {
+    // Set TX mode
+    device_commands_set_prim_rx(&self->commands_handler, 0);
+
+    // Load the packet once and keep it in the TX FIFO
+    spi_interface_command commands[3];
+    spi_interface_queue queue;
+    spi_interface_queue_init(&queue, commands, 3);
+    spi_interface_queue_add(&queue, COMMAND_CODE_FLUSH_TX, NULL, 0, NULL, 0);
+    spi_interface_queue_add(&queue, COMMAND_CODE_W_TX_PAYLOAD_NO_ACK, packet, packet_length, NULL, 0);
+    spi_interface_queue_add(&queue, COMMAND_CODE_REUSE_TX_PL, NULL, 0, NULL, 0);
+    device_commands_run_queue(&self->commands_handler, &queue);
+
+    uint32_t sent = 0;
+    uint32_t send_time = nrf24l01_hal_get_us_ticks();
+    while (count == 0 || sent < count) {
+        if (stop != NULL && stop(context)) {
+            break;
+        }
+
+        // Each pulse sends the packet again. TX_DS is left set, nothing waits for it
+        spi_interface_pulse_ce(&self->spi_handler);
+        sent++;
+
+        // Wait for the next send (or for the last one to go out before the flush), scheduled from
+        // the previous one so the interval doesn't drift
+        uint32_t elapsed = nrf24l01_hal_elapsed_us(send_time);
+        if (elapsed < interval_us) {
+            nrf24l01_hal_sleep_us(interval_us - elapsed);
+            send_time += interval_us;
+        } else {
+            send_time = nrf24l01_hal_get_us_ticks();
+        }
+    }
+
+    // Stop reusing the packet and clear the events of the sends
+    device_commands_flush_tx(&self->commands_handler);
+    device_commands_clear_status(&self->commands_handler, STATUS_MASK_TX_DS);
+    return sent;
 }
 
-int nrf24l01_receive_packets(nrf24l01 *self, uint8_t **packets, int count, uint32_t timeout) {
+void nrf24l01_set_ack_payload(nrf24l01 *self, uint32_t pipe, uint8_t *payload, uint8_t payload_length) {
+    if (pipe > 5) {
+        printf("Valid pipe range: [0, 5]. Given is %d\r\n", (int) pipe);
+        return;
+    }
+
+    device_commands_w_ack_payload(&self->commands_handler, pipe, payload, payload_length);
+}
+
+// Reads the payload of the given width at the head of the RX FIFO, received on the given pipe.
+// Returns false once no more packets are wanted.
+typedef bool (*nrf24l01_receive_sink)(nrf24l01 *self, uint8_t pipe, uint8_t payload_width, void *context);
+
+// Receives packets into the sink until it wants no more or, if use_timeout is set, no packet
+// came for the timeout once packets arrived. Returns the number of packets received.
+static int nrf24l01_receive(
+        nrf24l01 *self, nrf24l01_receive_sink sink, void *context, bool use_timeout, uint32_t timeout_us) {
     // Set RX mode
     device_commands_set_prim_rx(&self->commands_handler, 1);
 
     // Clear any leftover packets
     device_commands_flush_rx(&self->commands_handler);
 
+    bool use_irq = nrf24l01_irq_usable(self, STATUS_MASK_RX_DR);
     spi_interface_enable_ce(&self->spi_handler);
-    uint32_t packets_read = 0;
-    uint32_t last_packet_time = nrf24l01_hal_get_ms_ticks();
-    while (true) {
-        // Read RX_DR
-        bool rx_dr;
-        device_commands_get_rx_dr(&self->commands_handler, &rx_dr);
-        if (!rx_dr) {
-            int64_t time_ms = nrf24l01_hal_get_ms_ticks() - last_packet_time;
-            if (time_ms > timeout && packets_read > 0) {
-                return packets_read;
+    int packets_read = 0;
+    uint32_t last_packet_time = nrf24l01_hal_get_us_ticks();
+    bool done = false;
+    while (!done) {
+        // Read RX_DR, once the IRQ pin (if usable) signals an event. Once packets arrived, don't
+        // wait for it longer than the timeout.
+        bool timing = use_timeout && packets_read > 0;
+        uint8_t status = 0;
+        if (!use_irq || spi_interface_wait_irq(&self->spi_handler, timing ? timeout_us : UINT32_MAX)) {
+            status = device_commands_nop(&self->commands_handler);
+        }
+        // TX_DS only tells that an ACK payload went out, clear it to release the IRQ pin
+        uint8_t events = status & (STATUS_MASK_RX_DR | STATUS_MASK_TX_DS);
+        if (!(status & STATUS_MASK_RX_DR)) {
+            if (events) {
+                device_commands_clear_status(&self->commands_handler, events);
+            }
+            if (timing && nrf24l01_hal_elapsed_us(last_packet_time) > timeout_us) {
+                break;
             }
             continue;
         }
 
-        // Read packets as long as RX FIFO is not empty
-        bool packets_left = true;
-        while (packets_left) {
-            last_packet_time = nrf24l01_hal_get_ms_ticks();
+        // Clear RX_DR (and TX_DS) before draining the RX FIFO. A packet arriving during the drain
+        // then sets RX_DR again instead of having its event cleared along with the older ones.
+        device_commands_clear_status(&self->commands_handler, events);
 
-            // Read the payload width
+        // Read packets as long as RX FIFO is not empty
+        while (true) {
+            // Read the payload width. The STATUS captured alongside tells if the RX FIFO is empty
+            // and which pipe the payload came from
             uint8_t payload_width;
-            device_commands_r_rx_pl_wid(&self->commands_handler, &payload_width);
+            status = device_commands_r_rx_pl_wid(&self->commands_handler, &payload_width);
+            if ((status & STATUS_MASK_RX_P_NO) == STATUS_MASK_RX_P_NO) {
+                break;
+            }
+
+            last_packet_time = nrf24l01_hal_get_us_ticks();
 
             // Flush RX if the payload is bigger than 32 bytes
             if (payload_width > 32) {
@@ -332,23 +728,12 @@ int nrf24l01_receive_packets(nrf24l01 *self, uint8_t **packets, int count, uint3
             }
 
             // Read the payload
-            device_commands_r_rx_payload(&self->commands_handler, packets[packets_read], payload_width);
+            uint8_t pipe = (status & STATUS_MASK_RX_P_NO) >> 1;
             packets_read++;
-            if (packets_read == count) {
+            if (!sink(self, pipe, payload_width, context)) {
+                done = true;
                 break;
             }
-
-            // Check RX_EMPTY to see if there are more packets
-            bool rx_empty;
-            device_commands_get_rx_empty(&self->commands_handler, &rx_empty);
-            packets_left = !rx_empty;
-        }
-
-        // Clear RX_DR
-        device_commands_clear_rx_dr(&self->commands_handler);
-
-        if (packets_read == count) {
-            break;
         }
     }
 
@@ -356,49 +741,151 @@ int nrf24l01_receive_packets(nrf24l01 *self, uint8_t **packets, int count, uint3
     return packets_read;
 }
 
+typedef struct {
+    uint8_t **packets;
+    uint8_t *pipes;
+    int count;
+    int read;
+} nrf24l01_buffers_sink;
+
+static bool nrf24l01_sink_to_buffers(nrf24l01 *self, uint8_t pipe, uint8_t payload_width, void *context) {
+    nrf24l01_buffers_sink *sink = context;
+    device_commands_r_rx_payload(&self->commands_handler, sink->packets[sink->read], payload_width);
+    if (sink->pipes != NULL) {
+        sink->pipes[sink->read] = pipe;
+    }
+    sink->read++;
+    return sink->read < sink->count;
+}
+
+typedef struct {
+    void (*value_callback)(uint8_t *packet, uint8_t packet_length);
+    nrf24l01_packet_callback callback;
+    void *context;
+} nrf24l01_callback_sink;
+
+static bool nrf24l01_sink_to_callback(nrf24l01 *self, uint8_t pipe, uint8_t payload_width, void *context) {
+    nrf24l01_callback_sink *sink = context;
+    uint8_t packet[32];
+    device_commands_r_rx_payload(&self->commands_handler, packet, payload_width);
+    if (sink->callback != NULL) {
+        sink->callback(pipe, packet, payload_width, sink->context);
+    } else {
+        sink->value_callback(packet, payload_width);
+    }
+    return true;
+}
+
+// Saturates to UINT32_MAX, so the longest timeouts wait indefinitely instead of wrapping around
+static uint32_t nrf24l01_ms_to_us(uint32_t ms) {
+    return ms > UINT32_MAX / 1000 ? UINT32_MAX : ms * 1000;
+}
+
+int nrf24l01_receive_packet_us(nrf24l01 *self, uint8_t *packet, uint32_t timeout_us) {
+    uint8_t *packets[] = { packet };
+    return nrf24l01_receive_packets_us(self, packets, 1, timeout_us);
+}
+
+int nrf24l01_receive_packet(nrf24l01 *self, uint8_t *packet, uint32_t timeout) {
+    return nrf24l01_receive_packet_us(self, packet, nrf24l01_ms_to_us(timeout));
+}
+
+int nrf24l01_receive_packets_us(nrf24l01 *self, uint8_t **packets, int count, uint32_t timeout_us) {
+    return nrf24l01_receive_packets_pipes(self, packets, NULL, count, timeout_us);
+}
+
+int nrf24l01_receive_packets(nrf24l01 *self, uint8_t **packets, int count, uint32_t timeout) {
+    return nrf24l01_receive_packets_us(self, packets, count, nrf24l01_ms_to_us(timeout));
+}
+
 void nrf24l01_receive_packets_inf(nrf24l01 *self, void (*value_callback)(uint8_t *packet, uint8_t packet_length)) {
-    // Set RX mode
-    device_commands_set_prim_rx(&self->commands_handler, 1);
+    nrf24l01_callback_sink sink = { value_callback, NULL, NULL };
+    nrf24l01_receive(self, nrf24l01_sink_to_callback, &sink, false, 0);
+}
 
-    // Clear any leftover packets
-    device_commands_flush_rx(&self->commands_handler);
+int nrf24l01_receive_packets_pipes(nrf24l01 *self, uint8_t **packets, uint8_t *pipes, int count, uint32_t timeout_us) {
+    nrf24l01_buffers_sink sink = { packets, pipes, count, 0 };
+    return nrf24l01_receive(self, nrf24l01_sink_to_buffers, &sink, true, timeout_us);
+}
 
-    spi_interface_enable_ce(&self->spi_handler);
-    while (true) {
-        // Read RX_DR
-        bool rx_dr;
-        device_commands_get_rx_dr(&self->commands_handler, &rx_dr);
-        if (!rx_dr) {
-            continue;
-        }
+void nrf24l01_receive_packets_inf_pipes(nrf24l01 *self, nrf24l01_packet_callback callback, void *context) {
+    nrf24l01_callback_sink sink = { NULL, callback, context };
+    nrf24l01_receive(self, nrf24l01_sink_to_callback, &sink, false, 0);
+}
 
-        // Read packets as long as RX FIFO is not empty
-        bool packets_left = true;
-        while (packets_left) {
-            // Read the payload width
-            uint8_t payload_width;
-            device_commands_r_rx_pl_wid(&self->commands_handler, &payload_width);
+void nrf24l01_packet_queue_init(
+        nrf24l01_packet_queue *self, uint8_t (*packets)[32], uint8_t *packet_lengths, uint32_t capacity) {
+    self->packets = packets;
+    self->packet_lengths = packet_lengths;
+    self->capacity = capacity;
+    self->head = 0;
+    self->count = 0;
+    self->dropped = 0;
+}
 
-            // Flush RX if the payload is bigger than 32 bytes
-            if (payload_width > 32) {
-                device_commands_flush_rx(&self->commands_handler);
-                break;
-            }
+bool nrf24l01_packet_queue_pop(nrf24l01_packet_queue *self, uint8_t *packet, uint8_t *packet_length) {
+    if (self->count == 0) {
+        return false;
+    }
 
-            // Read the payload
-            uint8_t packet[payload_width];
-            device_commands_r_rx_payload(&self->commands_handler, packet, payload_width);
-            value_callback(packet, payload_width);
-
-            // Check RX_EMPTY to see if there are more packets
-            bool rx_empty;
-            device_commands_get_rx_empty(&self->commands_handler, &rx_empty);
-            packets_left = !rx_empty;
-        }
+    *packet_length = self->packet_lengths[self->head];
+    memcpy(packet, self->packets[self->head], *packet_length);
+    self->head = (self->head + 1) % self->capacity;
+    self->count--;
+    return true;
+}
 
-        // Clear RX_DR
-        device_commands_clear_rx_dr(&self->commands_handler);
+void nrf24l01_set_pipe_queue(nrf24l01 *self, uint32_t pipe, nrf24l01_packet_queue *queue) {
+    if (pipe >= NRF24L01_PIPE_COUNT) {
+        printf("Valid pipe range: [0, 5]. Given is %d\r\n", (int) pipe);
+        return;
     }
 
-    spi_interface_disable_ce(&self->spi_handler);
+    self->pipe_handlers[pipe].queue = queue;
+}
+
+void nrf24l01_set_pipe_callback(nrf24l01 *self, uint32_t pipe, nrf24l01_packet_callback callback, void *context) {
+    if (pipe >= NRF24L01_PIPE_COUNT) {
+        printf("Valid pipe range: [0, 5]. Given is %d\r\n", (int) pipe);
+        return;
+    }
+
+    self->pipe_handlers[pipe].context = context;
+    self->pipe_handlers[pipe].callback = callback;
+}
+
+typedef struct {
+    int count;
+    int read;
+} nrf24l01_demux_sink;
+
+static bool nrf24l01_sink_to_pipe(nrf24l01 *self, uint8_t pipe, uint8_t payload_width, void *context) {
+    nrf24l01_demux_sink *sink = context;
+    sink->read++;
+
+    nrf24l01_pipe_handler *handler = pipe < NRF24L01_PIPE_COUNT ? &self->pipe_handlers[pipe] : NULL;
+    nrf24l01_packet_queue *queue = handler != NULL ? handler->queue : NULL;
+    if (queue != NULL && queue->count < queue->capacity) {
+        // Read the payload straight into the queue
+        uint32_t tail = (queue->head + queue->count) % queue->capacity;
+        device_commands_r_rx_payload(&self->commands_handler, queue->packets[tail], payload_width);
+        queue->packet_lengths[tail] = payload_width;
+        queue->count++;
+    } else {
+        // The payload must leave the RX FIFO even if nobody takes it
+        uint8_t packet[32];
+        device_commands_r_rx_payload(&self->commands_handler, packet, payload_width);
+        if (queue != NULL) {
+            queue->dropped++;
+        } else if (handler != NULL && handler->callback != NULL) {
+            handler->callback(pipe, packet, payload_width, handler->context);
+        }
+    }
+
+    return sink->count == 0 || sink->read < sink->count;
+}
+
+int nrf24l01_receive_packets_demux(nrf24l01 *self, int count, uint32_t timeout_us) {
+    nrf24l01_demux_sink sink = { count, 0 };
+    return nrf24l01_receive(self, nrf24l01_sink_to_pipe, &sink, count > 0, timeout_us);
 }